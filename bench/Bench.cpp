@@ -0,0 +1,73 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "Bench.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+std::vector<carpal_bench::Benchmark>& carpal_bench::registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+std::vector<long> carpal_bench::threadCounts() {
+    long hardwareThreads = std::thread::hardware_concurrency();
+    if(hardwareThreads < 1) hardwareThreads = 1;
+    std::vector<long> ret;
+    for(long n=1 ; n<hardwareThreads ; n*=2) {
+        ret.push_back(n);
+    }
+    ret.push_back(hardwareThreads);
+    return ret;
+}
+
+namespace {
+
+struct Measurement {
+    double nsPerIteration;
+    double itemsPerSecond;
+};
+
+/** @brief Runs the benchmark with increasing iteration counts until it takes long enough to measure*/
+Measurement measure(carpal_bench::Benchmark const& benchmark, long arg) {
+    constexpr auto minDuration = std::chrono::milliseconds(200);
+    size_t iterations = 1;
+    while(true) {
+        carpal_bench::State state(iterations, arg);
+        auto start = std::chrono::steady_clock::now();
+        benchmark.func(state);
+        auto duration = std::chrono::steady_clock::now() - start;
+        if(duration >= minDuration || iterations >= (size_t(1) << 30)) {
+            double ns = std::chrono::duration<double, std::nano>(duration).count();
+            return Measurement{ns / iterations, state.itemsProcessed() * 1e9 / ns};
+        }
+        iterations *= 4;
+    }
+}
+
+void report(std::string const& name, Measurement const& m) {
+    printf("%-50s %12.1f ns %14.0f items/s\n", name.c_str(), m.nsPerIteration, m.itemsPerSecond);
+    fflush(stdout);
+}
+
+} // namespace
+
+/** Usage: carpal_bench [substring]
+ * Runs all benchmarks whose name contains the given substring (all of them, if none is given).*/
+int main(int argc, char** argv) {
+    char const* filter = (argc > 1) ? argv[1] : "";
+    for(carpal_bench::Benchmark const& benchmark : carpal_bench::registry()) {
+        if(strstr(benchmark.name.c_str(), filter) == nullptr) continue;
+        if(benchmark.args.empty()) {
+            report(benchmark.name, measure(benchmark, 0));
+        } else {
+            for(long arg : benchmark.args) {
+                report(benchmark.name + "/" + std::to_string(arg), measure(benchmark, arg));
+            }
+        }
+    }
+    return 0;
+}
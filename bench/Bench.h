@@ -0,0 +1,92 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace carpal_bench {
+
+/** @brief Passed to a benchmark function; the function must execute its workload @c iterations() times and
+ * may call @c doNotOptimize() on results so that the compiler does not drop the computation.*/
+class State {
+public:
+    State(size_t iterations, long arg)
+        :m_iterations(iterations),
+        m_arg(arg)
+    {}
+
+    size_t iterations() const {
+        return m_iterations;
+    }
+
+    /** @brief The argument the benchmark is run with (typically, a number of threads), for benchmarks registered
+     * with @c CARPAL_BENCHMARK_ARGS*/
+    long arg() const {
+        return m_arg;
+    }
+
+    /** @brief Sets the number of items (operations) processed in total, if different from the number of iterations;
+     * used for computing the throughput.*/
+    void setItemsProcessed(size_t items) {
+        m_itemsProcessed = items;
+    }
+
+    size_t itemsProcessed() const {
+        return m_itemsProcessed != 0 ? m_itemsProcessed : m_iterations;
+    }
+
+    template<typename T>
+    static void doNotOptimize(T const& val) {
+        asm volatile("" : : "r,m"(val) : "memory");
+    }
+
+private:
+    size_t m_iterations;
+    long m_arg;
+    size_t m_itemsProcessed = 0;
+};
+
+using BenchmarkFunc = std::function<void(State&)>;
+
+struct Benchmark {
+    std::string name;
+    BenchmarkFunc func;
+    /** @brief The values for @c State::arg(); if empty, the benchmark is run once, without argument*/
+    std::vector<long> args;
+};
+
+/** @brief Returns the list of all registered benchmarks*/
+std::vector<Benchmark>& registry();
+
+/** @brief Returns the thread counts for the scaling sweeps: powers of 2, up to the hardware concurrency, and the hardware
+ * concurrency itself*/
+std::vector<long> threadCounts();
+
+struct Registrar {
+    Registrar(char const* name, BenchmarkFunc func, std::vector<long> args = {}) {
+        registry().push_back(Benchmark{name, std::move(func), std::move(args)});
+    }
+};
+
+} // namespace carpal_bench
+
+#define CARPAL_BENCH_CONCAT2(a, b) a##b
+#define CARPAL_BENCH_CONCAT(a, b) CARPAL_BENCH_CONCAT2(a, b)
+
+/** @brief Defines and registers a benchmark. Usage: @code CARPAL_BENCHMARK("name", state) { ... } @endcode*/
+#define CARPAL_BENCHMARK(name, state) \
+    static void CARPAL_BENCH_CONCAT(carpalBenchFunc, __LINE__)(carpal_bench::State& state); \
+    static carpal_bench::Registrar CARPAL_BENCH_CONCAT(carpalBenchRegistrar, __LINE__)(name, &CARPAL_BENCH_CONCAT(carpalBenchFunc, __LINE__)); \
+    static void CARPAL_BENCH_CONCAT(carpalBenchFunc, __LINE__)(carpal_bench::State& state)
+
+/** @brief Defines and registers a benchmark to be run once for each of the given arguments (a @c std::vector<long>),
+ * available as @c state.arg(). Usage: @code CARPAL_BENCHMARK_ARGS("name", state, carpal_bench::threadCounts()) { ... } @endcode*/
+#define CARPAL_BENCHMARK_ARGS(name, state, args) \
+    static void CARPAL_BENCH_CONCAT(carpalBenchFunc, __LINE__)(carpal_bench::State& state); \
+    static carpal_bench::Registrar CARPAL_BENCH_CONCAT(carpalBenchRegistrar, __LINE__)(name, &CARPAL_BENCH_CONCAT(carpalBenchFunc, __LINE__), args); \
+    static void CARPAL_BENCH_CONCAT(carpalBenchFunc, __LINE__)(carpal_bench::State& state)
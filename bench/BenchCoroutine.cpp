@@ -0,0 +1,87 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "Bench.h"
+
+#include "carpal/AsyncCoroutine.h"
+#include "carpal/Future.h"
+#include "carpal/Task.h"
+#include "carpal/ThreadPool.h"
+
+using namespace carpal;
+
+namespace {
+
+AsyncCoroutine<size_t> awaitCompleted(CoroutineScheduler*, size_t count) {
+    Future<size_t> f = completedFuture(size_t(1));
+    size_t sum = 0;
+    for(size_t i=0 ; i<count ; ++i) {
+        sum += co_await f;
+    }
+    co_return sum;
+}
+
+AsyncCoroutine<size_t> awaitOnExecutor(CoroutineScheduler*, Executor* pExecutor, size_t count) {
+    size_t sum = 0;
+    for(size_t i=0 ; i<count ; ++i) {
+        sum += co_await runAsync(pExecutor, []() { return size_t(1); });
+    }
+    co_return sum;
+}
+
+} // namespace
+
+CARPAL_BENCHMARK("coroutine/co_await_completed_future", state) {
+    CoroutineScheduler scheduler;
+    AsyncCoroutine<size_t> coro = awaitCompleted(&scheduler, state.iterations());
+    state.doNotOptimize(coro.get());
+}
+
+CARPAL_BENCHMARK_ARGS("coroutine/co_await_runAsync", state, carpal_bench::threadCounts()) {
+    CoroutineScheduler scheduler;
+    ThreadPool tp(static_cast<unsigned>(state.arg()));
+    AsyncCoroutine<size_t> coro = awaitOnExecutor(&scheduler, &tp, state.iterations());
+    state.doNotOptimize(coro.get());
+}
+
+namespace {
+
+Task<size_t> taskOne() {
+    co_return size_t(1);
+}
+
+AsyncCoroutine<size_t> awaitTasks(CoroutineScheduler*, size_t count) {
+    size_t sum = 0;
+    for(size_t i=0 ; i<count ; ++i) {
+        sum += co_await taskOne();
+    }
+    co_return sum;
+}
+
+AsyncCoroutine<size_t> coroOne(CoroutineScheduler*) {
+    co_return size_t(1);
+}
+
+AsyncCoroutine<size_t> awaitAsyncCoroutines(CoroutineScheduler* pScheduler, size_t count) {
+    size_t sum = 0;
+    for(size_t i=0 ; i<count ; ++i) {
+        AsyncCoroutine<size_t> inner = coroOne(pScheduler);
+        sum += co_await inner;
+    }
+    co_return sum;
+}
+
+} // namespace
+
+CARPAL_BENCHMARK("coroutine/co_await_AsyncCoroutine", state) {
+    CoroutineScheduler scheduler;
+    AsyncCoroutine<size_t> coro = awaitAsyncCoroutines(&scheduler, state.iterations());
+    state.doNotOptimize(coro.get());
+}
+
+CARPAL_BENCHMARK("coroutine/co_await_Task", state) {
+    CoroutineScheduler scheduler;
+    AsyncCoroutine<size_t> coro = awaitTasks(&scheduler, state.iterations());
+    state.doNotOptimize(coro.get());
+}
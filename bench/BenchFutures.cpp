@@ -0,0 +1,169 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "Bench.h"
+
+#include "carpal/Future.h"
+#include "carpal/ThreadPool.h"
+#include "carpal/WorkStealingThreadPool.h"
+
+#include <thread>
+#include <vector>
+
+using namespace carpal;
+
+namespace {
+
+constexpr size_t batchSize = 256;
+
+/** @brief Submits @c state.iterations() tasks through runAsync() from @c state.arg() producer threads, into the given
+ * executor, waiting for them in batches*/
+void runAsyncThroughput(carpal_bench::State& state, Executor* pExecutor) {
+    size_t nrProducers = static_cast<size_t>(state.arg());
+    std::vector<std::thread> producers;
+    for(size_t t=0 ; t<nrProducers ; ++t) {
+        size_t count = state.iterations() / nrProducers + (t < state.iterations() % nrProducers ? 1 : 0);
+        producers.emplace_back([pExecutor, count]() {
+            std::vector<Future<int> > futures;
+            futures.reserve(batchSize);
+            for(size_t i=0 ; i<count ; ++i) {
+                futures.push_back(runAsync(pExecutor, [i]() { return int(i); }));
+                if(futures.size() == batchSize || i + 1 == count) {
+                    for(auto& f : futures) {
+                        carpal_bench::State::doNotOptimize(f.get());
+                    }
+                    futures.clear();
+                }
+            }
+        });
+    }
+    for(auto& t : producers) {
+        t.join();
+    }
+}
+
+constexpr int chainLength = 10;
+
+/** @brief Measures the time from completing a future to the completion of a chain of continuations on it*/
+void thenChainLatency(carpal_bench::State& state, Executor* pExecutor) {
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        Promise<int> promise;
+        Future<int> f = promise.future();
+        for(int j=0 ; j<chainLength ; ++j) {
+            f = f.then(pExecutor, [](int v) { return v + 1; });
+        }
+        promise.set(int(i));
+        state.doNotOptimize(f.get());
+    }
+}
+
+constexpr size_t fanInSize = 10000;
+
+void fanIn(carpal_bench::State& state, Executor* pExecutor) {
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        std::vector<Promise<int> > promises(fanInSize);
+        std::vector<Future<int> > futures;
+        futures.reserve(fanInSize);
+        for(auto& p : promises) {
+            futures.push_back(p.future());
+        }
+        Future<int> sum = whenAllFromArrayOfFutures(pExecutor, [](std::vector<Future<int> > results) {
+            int s = 0;
+            for(auto& f : results) s += f.get();
+            return s;
+        }, std::move(futures));
+        for(size_t j=0 ; j<fanInSize ; ++j) {
+            promises[j].set(int(j));
+        }
+        state.doNotOptimize(sum.get());
+    }
+    state.setItemsProcessed(state.iterations() * fanInSize);
+}
+
+void fanInReduce(carpal_bench::State& state, Executor* pExecutor) {
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        std::vector<Promise<int> > promises(fanInSize);
+        std::vector<Future<int> > futures;
+        futures.reserve(fanInSize);
+        for(auto& p : promises) {
+            futures.push_back(p.future());
+        }
+        Future<int> sum = whenAllReduce(pExecutor, std::move(futures), 0, [](int s, int v) { return s + v; });
+        for(size_t j=0 ; j<fanInSize ; ++j) {
+            promises[j].set(int(j));
+        }
+        state.doNotOptimize(sum.get());
+    }
+    state.setItemsProcessed(state.iterations() * fanInSize);
+}
+
+void asyncLoop(carpal_bench::State& state, Executor* pExecutor) {
+    size_t nrIterations = state.iterations();
+    Future<size_t> f = completedFuture(size_t(0)).thenAsyncLoop(pExecutor,
+        [nrIterations](size_t i) { return i < nrIterations; },
+        [pExecutor](size_t i) { return runAsync(pExecutor, [i]() { return i + 1; }); });
+    state.doNotOptimize(f.get());
+}
+
+void asyncLoopCompleted(carpal_bench::State& state) {
+    size_t nrIterations = state.iterations();
+    Future<size_t> f = completedFuture(size_t(0)).thenAsyncLoop(
+        [nrIterations](size_t i) { return i < nrIterations; },
+        [](size_t i) { return completedFuture(i + 1); });
+    state.doNotOptimize(f.get());
+}
+
+} // namespace
+
+CARPAL_BENCHMARK_ARGS("futures/runAsync/ThreadPool", state, carpal_bench::threadCounts()) {
+    ThreadPool tp(static_cast<unsigned>(state.arg()));
+    runAsyncThroughput(state, &tp);
+}
+
+CARPAL_BENCHMARK_ARGS("futures/runAsync/WorkStealingThreadPool", state, carpal_bench::threadCounts()) {
+    WorkStealingThreadPool tp(static_cast<unsigned>(state.arg()));
+    runAsyncThroughput(state, &tp);
+}
+
+CARPAL_BENCHMARK_ARGS("futures/then_chain/ThreadPool", state, carpal_bench::threadCounts()) {
+    ThreadPool tp(static_cast<unsigned>(state.arg()));
+    thenChainLatency(state, &tp);
+}
+
+CARPAL_BENCHMARK_ARGS("futures/then_chain/WorkStealingThreadPool", state, carpal_bench::threadCounts()) {
+    WorkStealingThreadPool tp(static_cast<unsigned>(state.arg()));
+    thenChainLatency(state, &tp);
+}
+
+CARPAL_BENCHMARK("futures/then_chain/inline", state) {
+    thenChainLatency(state, inlineExecutor());
+}
+
+CARPAL_BENCHMARK_ARGS("futures/whenAllFromArrayOfFutures_10k/ThreadPool", state, carpal_bench::threadCounts()) {
+    ThreadPool tp(static_cast<unsigned>(state.arg()));
+    fanIn(state, &tp);
+}
+
+CARPAL_BENCHMARK_ARGS("futures/whenAllReduce_10k/ThreadPool", state, carpal_bench::threadCounts()) {
+    ThreadPool tp(static_cast<unsigned>(state.arg()));
+    fanInReduce(state, &tp);
+}
+
+CARPAL_BENCHMARK("futures/whenAllReduce_10k/inline", state) {
+    fanInReduce(state, inlineExecutor());
+}
+
+CARPAL_BENCHMARK_ARGS("futures/thenAsyncLoop/ThreadPool", state, carpal_bench::threadCounts()) {
+    ThreadPool tp(static_cast<unsigned>(state.arg()));
+    asyncLoop(state, &tp);
+}
+
+CARPAL_BENCHMARK_ARGS("futures/thenAsyncLoop/WorkStealingThreadPool", state, carpal_bench::threadCounts()) {
+    WorkStealingThreadPool tp(static_cast<unsigned>(state.arg()));
+    asyncLoop(state, &tp);
+}
+
+CARPAL_BENCHMARK("futures/thenAsyncLoop/completed_body", state) {
+    asyncLoopCompleted(state);
+}
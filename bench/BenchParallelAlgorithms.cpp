@@ -0,0 +1,53 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "Bench.h"
+
+#include "carpal/Future.h"
+#include "carpal/ParallelAlgorithms.h"
+#include "carpal/ThreadPool.h"
+
+#include <vector>
+
+using namespace carpal;
+
+namespace {
+
+constexpr size_t loopSize = 100000;
+
+/** @brief The hand-written way: one task per element, joined by whenAllFromArrayOfFutures()*/
+void runAsyncPerElement(carpal_bench::State& state, Executor* pExecutor) {
+    std::vector<int> v(loopSize);
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        std::vector<Future<void> > futures;
+        futures.reserve(loopSize);
+        for(size_t j=0 ; j<loopSize ; ++j) {
+            futures.push_back(runAsync(pExecutor, [&v, j]() { v[j] = int(j); }));
+        }
+        whenAllFromArrayOfFutures(pExecutor, [](std::vector<Future<void> >) {}, std::move(futures)).wait();
+    }
+    state.doNotOptimize(v[loopSize / 2]);
+    state.setItemsProcessed(state.iterations() * loopSize);
+}
+
+void parallelForLoop(carpal_bench::State& state, Executor* pExecutor) {
+    std::vector<int> v(loopSize);
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        parallelFor(pExecutor, 0, loopSize, [&v](size_t j) { v[j] = int(j); }).wait();
+    }
+    state.doNotOptimize(v[loopSize / 2]);
+    state.setItemsProcessed(state.iterations() * loopSize);
+}
+
+} // namespace
+
+CARPAL_BENCHMARK_ARGS("parallel/runAsync_per_element_100k", state, carpal_bench::threadCounts()) {
+    ThreadPool tp(static_cast<unsigned>(state.arg()));
+    runAsyncPerElement(state, &tp);
+}
+
+CARPAL_BENCHMARK_ARGS("parallel/parallelFor_100k", state, carpal_bench::threadCounts()) {
+    ThreadPool tp(static_cast<unsigned>(state.arg()));
+    parallelForLoop(state, &tp);
+}
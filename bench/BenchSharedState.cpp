@@ -0,0 +1,199 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "Bench.h"
+
+#include "carpal/Future.h"
+#include "carpal/MemoryResource.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+using namespace carpal;
+
+namespace {
+
+/** @brief Executes the tasks immediately, so that the benchmarks measure the future machinery and not the thread pool*/
+class ImmediateExecutor : public Executor {
+public:
+    void enqueue(Runnable func) override {
+        func();
+    }
+};
+
+ImmediateExecutor immediateExecutor;
+
+/** @brief Reduced copy of the previous shared state design, as a baseline: @c std::shared_ptr handles, a mutex and a
+ * condition variable per state, @c std::function callbacks, and continuations created by @c std::make_shared and then
+ * captured by copy into the callbacks.*/
+namespace legacy {
+
+template<typename T>
+class SharedState {
+public:
+    virtual ~SharedState() = default;
+
+    void set(T val) {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        m_val = std::move(val);
+        m_isComplete = true;
+        m_cv.notify_all();
+        std::vector<std::function<void()> > callbacks = std::move(m_callbacks);
+        lck.unlock();
+        for(auto& callback : callbacks) {
+            callback();
+        }
+    }
+
+    T& get() {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        m_cv.wait(lck, [this]() { return m_isComplete; });
+        return *m_val;
+    }
+
+    void addSynchronousCallback(std::function<void()> callback) {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        if(m_isComplete) {
+            lck.unlock();
+            callback();
+        } else {
+            m_callbacks.push_back(std::move(callback));
+        }
+    }
+
+private:
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    bool m_isComplete = false;
+    std::optional<T> m_val;
+    std::vector<std::function<void()> > m_callbacks;
+};
+
+template<typename T, typename Func>
+class Continuation : public SharedState<T> {
+public:
+    Continuation(Executor* pExecutor, std::shared_ptr<SharedState<T> > pFuture, Func func)
+        :m_pExecutor(pExecutor), m_pFuture(std::move(pFuture)), m_func(std::move(func))
+    {}
+
+    static void onFutureCompleted(std::shared_ptr<Continuation> pThis) {
+        pThis->m_pExecutor->enqueue([pThis]() {
+            pThis->set(pThis->m_func(pThis->m_pFuture->get()));
+        });
+    }
+
+private:
+    Executor* m_pExecutor;
+    std::shared_ptr<SharedState<T> > m_pFuture;
+    Func m_func;
+};
+
+template<typename T>
+class Future {
+public:
+    explicit Future(std::shared_ptr<SharedState<T> > pState)
+        :m_pState(std::move(pState))
+    {}
+
+    template<typename Func>
+    Future<T> then(Executor* pExecutor, Func func) {
+        auto pRet = std::make_shared<Continuation<T, Func> >(pExecutor, m_pState, std::move(func));
+        m_pState->addSynchronousCallback([pRet]() { Continuation<T, Func>::onFutureCompleted(pRet); });
+        return Future<T>(pRet);
+    }
+
+    T& get() {
+        return m_pState->get();
+    }
+
+private:
+    std::shared_ptr<SharedState<T> > m_pState;
+};
+
+} // namespace legacy
+
+constexpr int chainLength = 10;
+
+} // namespace
+
+CARPAL_BENCHMARK("shared_state/legacy/set_get", state) {
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        auto pState = std::make_shared<legacy::SharedState<int> >();
+        pState->set(int(i));
+        state.doNotOptimize(pState->get());
+    }
+}
+
+CARPAL_BENCHMARK("shared_state/carpal/set_get", state) {
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        Promise<int> promise;
+        promise.set(int(i));
+        state.doNotOptimize(promise.future().get());
+    }
+}
+
+CARPAL_BENCHMARK("shared_state/carpal_pool/set_get", state) {
+    MemoryResourceScope scope(threadLocalPoolResource());
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        Promise<int> promise;
+        promise.set(int(i));
+        state.doNotOptimize(promise.future().get());
+    }
+}
+
+CARPAL_BENCHMARK("shared_state/legacy/then_chain", state) {
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        auto pState = std::make_shared<legacy::SharedState<int> >();
+        legacy::Future<int> f(pState);
+        for(int j=0 ; j<chainLength ; ++j) {
+            f = f.then(&immediateExecutor, [](int v) { return v + 1; });
+        }
+        pState->set(int(i));
+        state.doNotOptimize(f.get());
+    }
+}
+
+CARPAL_BENCHMARK("shared_state/carpal/then_chain", state) {
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        Promise<int> promise;
+        Future<int> f = promise.future();
+        for(int j=0 ; j<chainLength ; ++j) {
+            f = f.then(&immediateExecutor, [](int v) { return v + 1; });
+        }
+        promise.set(int(i));
+        state.doNotOptimize(f.get());
+    }
+}
+
+CARPAL_BENCHMARK("shared_state/carpal_pool/then_chain", state) {
+    MemoryResourceScope scope(threadLocalPoolResource());
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        Promise<int> promise;
+        Future<int> f = promise.future();
+        for(int j=0 ; j<chainLength ; ++j) {
+            f = f.then(&immediateExecutor, [](int v) { return v + 1; });
+        }
+        promise.set(int(i));
+        state.doNotOptimize(f.get());
+    }
+}
+
+CARPAL_BENCHMARK("shared_state/legacy/then_completed", state) {
+    auto pState = std::make_shared<legacy::SharedState<int> >();
+    pState->set(1);
+    legacy::Future<int> f(pState);
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        state.doNotOptimize(f.then(&immediateExecutor, [](int v) { return v + 1; }).get());
+    }
+}
+
+CARPAL_BENCHMARK("shared_state/carpal/then_completed", state) {
+    Future<int> f = completedFuture(1);
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        state.doNotOptimize(f.then(&immediateExecutor, [](int v) { return v + 1; }).get());
+    }
+}
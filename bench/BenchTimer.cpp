@@ -0,0 +1,90 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "Bench.h"
+
+#include "carpal/ShardedAlarmClock.h"
+#include "carpal/Timer.h"
+
+#include <thread>
+#include <vector>
+
+using namespace carpal;
+
+namespace {
+
+/** @brief From each of @c state.arg() threads, sets timers far in the future and cancels them, keeping up to
+ * @c nrPending timers pending per thread*/
+template<typename Clock>
+void setCancelTimers(carpal_bench::State& state, Clock& clock, size_t nrPending) {
+    size_t nrThreads = static_cast<size_t>(state.arg());
+    std::vector<std::thread> threads;
+    for(size_t t=0 ; t<nrThreads ; ++t) {
+        size_t count = state.iterations() / nrThreads + (t < state.iterations() % nrThreads ? 1 : 0);
+        threads.emplace_back([&clock, count, nrPending, t]() {
+            auto base = std::chrono::system_clock::now() + std::chrono::seconds(3600);
+            std::vector<Timer> pending;
+            pending.reserve(nrPending);
+            for(size_t i=0 ; i<count ; ++i) {
+                // spread the deadlines, so that the timers are not all inserted at the same position
+                pending.push_back(clock.setTimer(base + std::chrono::microseconds((i * 7919 + t) % 1000000)));
+                if(pending.size() == nrPending) {
+                    for(Timer& timer : pending) {
+                        timer.cancel();
+                    }
+                    pending.clear();
+                }
+            }
+            for(Timer& timer : pending) {
+                timer.cancel();
+            }
+        });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+}
+
+void setExpireTimers(carpal_bench::State& state, AlarmClock::Backend backend) {
+    AlarmClock clock(backend);
+    std::vector<Future<bool> > futures;
+    futures.reserve(state.iterations());
+    auto when = std::chrono::system_clock::now() + std::chrono::milliseconds(1);
+    for(size_t i=0 ; i<state.iterations() ; ++i) {
+        futures.push_back(clock.setTimer(when + std::chrono::nanoseconds(i)).getFuture());
+    }
+    for(auto& f : futures) {
+        state.doNotOptimize(f.get());
+    }
+}
+
+} // namespace
+
+CARPAL_BENCHMARK_ARGS("timer/setTimer_cancel/1_pending", state, carpal_bench::threadCounts()) {
+    AlarmClock clock;
+    setCancelTimers(state, clock, 1);
+}
+
+CARPAL_BENCHMARK_ARGS("timer/setTimer_cancel/1000_pending", state, carpal_bench::threadCounts()) {
+    AlarmClock clock;
+    setCancelTimers(state, clock, 1000);
+}
+
+CARPAL_BENCHMARK_ARGS("timer/setTimer_cancel/1000_pending/timingWheel", state, carpal_bench::threadCounts()) {
+    AlarmClock clock(AlarmClock::Backend::timingWheel);
+    setCancelTimers(state, clock, 1000);
+}
+
+CARPAL_BENCHMARK_ARGS("timer/setTimer_cancel/1000_pending/sharded", state, carpal_bench::threadCounts()) {
+    ShardedAlarmClock clock;
+    setCancelTimers(state, clock, 1000);
+}
+
+CARPAL_BENCHMARK("timer/setTimer_expire", state) {
+    setExpireTimers(state, AlarmClock::Backend::orderedSet);
+}
+
+CARPAL_BENCHMARK("timer/setTimer_expire/timingWheel", state) {
+    setExpireTimers(state, AlarmClock::Backend::timingWheel);
+}
@@ -0,0 +1,76 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/Cancellation.h"
+
+namespace carpal {
+
+namespace {
+
+thread_local carpal_private::CancellationState* currentState = nullptr;
+
+} // namespace
+
+namespace carpal_private {
+
+void CancellationState::cancel() {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    if(m_isCanceled.load(std::memory_order_relaxed)) return;
+    m_isCanceled.store(true, std::memory_order_release);
+    m_cancelingThread = std::this_thread::get_id();
+    while(!m_callbacks.empty()) {
+        // taken out of the list one at a time, so that a callback not started yet can still be removed
+        std::list<Callback> current;
+        current.splice(current.begin(), m_callbacks, m_callbacks.begin());
+        m_lastStartedId = current.front().id;
+        m_isCallbackRunning = true;
+        // executed without the lock, since they may complete futures and thus execute arbitrary continuations
+        lck.unlock();
+        current.front().func();
+        current.clear();
+        lck.lock();
+        m_isCallbackRunning = false;
+        m_callbackDone.notify_all();
+    }
+}
+
+bool CancellationState::addCallback(Runnable callback, CallbackHandle& handle) {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    if(m_isCanceled.load(std::memory_order_relaxed)) return false;
+    handle.m_id = ++m_lastId;
+    handle.m_it = m_callbacks.insert(m_callbacks.end(), Callback{handle.m_id, std::move(callback)});
+    return true;
+}
+
+void CancellationState::removeCallback(CallbackHandle const& handle) noexcept {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    if(handle.m_id > m_lastStartedId) {
+        // not started yet, so still in the list
+        m_callbacks.erase(handle.m_it);
+        return;
+    }
+    if(handle.m_id == m_lastStartedId && m_cancelingThread != std::this_thread::get_id()) {
+        m_callbackDone.wait(lck, [this, &handle]() {
+            return !m_isCallbackRunning || m_lastStartedId != handle.m_id;
+        });
+    }
+}
+
+CancellationState* currentCancellationState() noexcept {
+    return currentState;
+}
+
+CancellationState* setCurrentCancellationState(CancellationState* pState) noexcept {
+    CancellationState* pPrevious = currentState;
+    currentState = pState;
+    return pPrevious;
+}
+
+} // namespace carpal_private
+
+CancellationToken currentCancellationToken() noexcept {
+    return CancellationToken(RefPtr<carpal_private::CancellationState>(currentState));
+}
+
+} // namespace carpal
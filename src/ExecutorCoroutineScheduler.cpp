@@ -0,0 +1,41 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/ExecutorCoroutineScheduler.h"
+
+carpal::ExecutorCoroutineScheduler::ExecutorCoroutineScheduler(Executor* pExecutor)
+    :m_pExecutor(pExecutor)
+{}
+
+carpal::ExecutorCoroutineScheduler::~ExecutorCoroutineScheduler() = default;
+
+void carpal::ExecutorCoroutineScheduler::markRunnable(std::coroutine_handle<void> h) {
+    Runnable task([h]() {
+        h.resume();
+    });
+    if(!m_pExecutor->tryEnqueue(task)) {
+        // the coroutine must not be lost, so, if the executor refuses it, it is resumed on the current thread
+        h.resume();
+    }
+}
+
+void carpal::ExecutorCoroutineScheduler::markThreadRunnable(std::thread::id tid) {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    m_runnableThreads.insert(tid);
+    auto it = m_waitingThreads.find(tid);
+    if(it != m_waitingThreads.end()) {
+        it->second->notify_one();
+    }
+}
+
+std::coroutine_handle<void> carpal::ExecutorCoroutineScheduler::schedule() {
+    auto id = std::this_thread::get_id();
+    std::condition_variable cv;
+    std::unique_lock<std::mutex> lck(m_mtx);
+    m_waitingThreads[id] = &cv;
+    cv.wait(lck, [this, id]() { return m_runnableThreads.count(id) != 0; });
+    m_waitingThreads.erase(id);
+    m_runnableThreads.erase(id);
+    return nullptr;
+}
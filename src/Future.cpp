@@ -4,40 +4,123 @@
 
 #include "carpal/Future.h"
 #include "carpal/ThreadPool.h"
+#include "carpal/WorkStealingThreadPool.h"
 #include <thread>
 
 carpal::Executor* carpal::defaultExecutor() {
+#ifdef CARPAL_WORK_STEALING_DEFAULT_EXECUTOR
+    static WorkStealingThreadPool threadPool(std::thread::hardware_concurrency() + 1);
+#else
     static ThreadPool threadPool(std::thread::hardware_concurrency() + 1);
+#endif
     return &threadPool;
 }
 
+namespace {
+
+#ifndef __cpp_lib_atomic_wait
+/** @brief Without @c std::atomic::wait(), blocked threads park on one of a fixed set of condition variables,
+ * chosen by the address of the future.*/
+struct ParkingSlot {
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+ParkingSlot& parkingSlotFor(void const* pFuture) {
+    static ParkingSlot slots[64];
+    return slots[(reinterpret_cast<std::uintptr_t>(pFuture) >> 4) % 64];
+}
+#endif
+
+class FunctionCallbackNode : public carpal::CallbackNode {
+public:
+    explicit FunctionCallbackNode(carpal::Runnable func)
+        :m_func(std::move(func))
+    {}
+    void execute() noexcept override {
+        m_func();
+        delete this;
+    }
+    void discard() noexcept override {
+        delete this;
+    }
+private:
+    carpal::Runnable m_func;
+};
+
+} // namespace
+
 carpal::PromiseFuturePairBase::~PromiseFuturePairBase() {
+    CallbackNode* pNode = m_continuations.load(std::memory_order_acquire);
+    if(isCompletedMarker(pNode)) return;
+    while(pNode != nullptr) {
+        CallbackNode* pNext = pNode->m_pNextCallback;
+        pNode->discard();
+        pNode = pNext;
+    }
+}
+
+void carpal::PromiseFuturePairBase::waitForCompletion() const noexcept {
+#ifdef __cpp_lib_atomic_wait
+    CallbackNode* pNode = m_continuations.load(std::memory_order_acquire);
+    while(!isCompletedMarker(pNode)) {
+        // every added callback changes the value, so this may wake up before completion
+        m_continuations.wait(pNode, std::memory_order_acquire);
+        pNode = m_continuations.load(std::memory_order_acquire);
+    }
+#else
+    ParkingSlot& slot = parkingSlotFor(this);
+    std::unique_lock<std::mutex> lck(slot.mtx);
+    while(state() == State::not_completed) {
+        slot.cv.wait(lck);
+    }
+#endif
 }
 
 void carpal::PromiseFuturePairBase::notify(State state) {
-    std::unique_lock<std::mutex> lck(m_mtx);
-    std::function<void()> continuations = std::move(m_continuations);
-    m_cv.notify_all();
-    m_state = state;
-    lck.unlock();
-    if(continuations != nullptr) {
-        continuations();
+    // After this exchange, a waiter may return and destroy this object; only the address is used from now on
+    CallbackNode* pNode = m_continuations.exchange(completedMarker(state), std::memory_order_acq_rel);
+#ifdef __cpp_lib_atomic_wait
+    m_continuations.notify_all();
+#else
+    {
+        ParkingSlot& slot = parkingSlotFor(this);
+        std::unique_lock<std::mutex> lck(slot.mtx);
+        slot.cv.notify_all();
+    }
+#endif
+    // the stack has the last added callback first; reverse it to execute the callbacks in the order they were added
+    CallbackNode* pReversed = nullptr;
+    while(pNode != nullptr) {
+        CallbackNode* pNext = pNode->m_pNextCallback;
+        pNode->m_pNextCallback = pReversed;
+        pReversed = pNode;
+        pNode = pNext;
+    }
+    while(pReversed != nullptr) {
+        CallbackNode* pNext = pReversed->m_pNextCallback;
+        pReversed->execute();
+        pReversed = pNext;
     }
 }
 
-void carpal::PromiseFuturePairBase::addSynchronousCallback(std::function<void()> func) {
-    std::unique_lock<std::mutex> lck(m_mtx);
-    if (m_state != State::not_completed) {
-        lck.unlock();
+void carpal::PromiseFuturePairBase::addSynchronousCallback(CallbackType func) {
+    if(isCompletedMarker(m_continuations.load(std::memory_order_acquire))) {
         func();
-    } else if(m_continuations == nullptr) {
-        m_continuations = std::move(func);
-    } else {
-        m_continuations = [oldCont=std::move(m_continuations),f=std::move(func)](){
-            oldCont();
-            f();
-        };
+        return;
     }
+    addCallbackNode(new FunctionCallbackNode(std::move(func)));
+}
+
+void carpal::PromiseFuturePairBase::addCallbackNode(CallbackNode* pNode) noexcept {
+    CallbackNode* pHead = m_continuations.load(std::memory_order_acquire);
+    do {
+        if(isCompletedMarker(pHead)) {
+            pNode->execute();
+            return;
+        }
+        pNode->m_pNextCallback = pHead;
+    } while(!m_continuations.compare_exchange_weak(pHead, pNode, std::memory_order_release, std::memory_order_acquire));
 }
 
 carpal::FutureWaiter::FutureWaiter() = default;
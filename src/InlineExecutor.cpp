@@ -0,0 +1,47 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/InlineExecutor.h"
+#include "carpal/Future.h"
+
+namespace {
+
+/** @brief Number of inline tasks currently being executed, nested, on this thread*/
+thread_local unsigned inlineDepth = 0;
+
+class DepthGuard {
+public:
+    DepthGuard() noexcept { ++inlineDepth; }
+    ~DepthGuard() { --inlineDepth; }
+    DepthGuard(DepthGuard const&) = delete;
+    DepthGuard& operator=(DepthGuard const&) = delete;
+};
+
+} // namespace
+
+carpal::InlineExecutor::InlineExecutor(Executor* pFallback, unsigned maxDepth)
+    :m_pFallback(pFallback)
+    ,m_maxDepth(maxDepth)
+{}
+
+void carpal::InlineExecutor::enqueue(Runnable func) {
+    if(!tryEnqueue(func)) {
+        throw ExecutorRejectedException();
+    }
+}
+
+bool carpal::InlineExecutor::tryEnqueue(Runnable& func) {
+    if(inlineDepth >= m_maxDepth) {
+        return (m_pFallback != nullptr ? m_pFallback : defaultExecutor())->tryEnqueue(func);
+    }
+    DepthGuard guard;
+    func();
+    func.reset();
+    return true;
+}
+
+carpal::Executor* carpal::inlineExecutor() {
+    static InlineExecutor executor;
+    return &executor;
+}
@@ -0,0 +1,195 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/MemoryResource.h"
+
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace carpal {
+
+namespace {
+
+thread_local std::pmr::memory_resource* currentResource = nullptr;
+
+constexpr std::size_t nrSizeClasses = ThreadLocalPoolResource::maxPooledSize / ThreadLocalPoolResource::granularity;
+constexpr std::size_t chunkSize = 64 * 1024;
+/** @brief Number of blocks moved at once between a thread's list and the shared list*/
+constexpr std::size_t batchSize = 32;
+/** @brief A thread gives back a batch to the shared list when it holds more than this many free blocks of a size*/
+constexpr std::size_t maxLocalBlocks = 8 * batchSize;
+
+struct FreeBlock {
+    FreeBlock* pNext;
+};
+
+std::size_t sizeClassOf(std::size_t bytes) noexcept {
+    if(bytes == 0) bytes = 1;
+    return (bytes + ThreadLocalPoolResource::granularity - 1) / ThreadLocalPoolResource::granularity - 1;
+}
+
+std::size_t blockSizeOf(std::size_t sizeClass) noexcept {
+    return (sizeClass + 1) * ThreadLocalPoolResource::granularity;
+}
+
+bool isPooled(std::size_t bytes, std::size_t alignment) noexcept {
+    return bytes <= ThreadLocalPoolResource::maxPooledSize && alignment <= ThreadLocalPoolResource::granularity;
+}
+
+struct FreeList {
+    FreeBlock* pHead = nullptr;
+    std::size_t count = 0;
+
+    void push(FreeBlock* pBlock) noexcept {
+        pBlock->pNext = pHead;
+        pHead = pBlock;
+        ++count;
+    }
+
+    FreeBlock* pop() noexcept {
+        FreeBlock* pBlock = pHead;
+        pHead = pBlock->pNext;
+        --count;
+        return pBlock;
+    }
+};
+
+/** @brief The free blocks shared among threads, and the chunks taken from the system*/
+class SharedLists {
+public:
+    /** @brief Moves up to @c batchSize blocks into the given list; returns false if there are none.*/
+    bool takeBatch(std::size_t sizeClass, FreeList& dest) {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        FreeList& src = m_lists[sizeClass];
+        if(src.count == 0) return false;
+        for(std::size_t i=0 ; i<batchSize && src.count > 0 ; ++i) {
+            dest.push(src.pop());
+        }
+        return true;
+    }
+
+    /** @brief Moves up to @c count blocks from the given list*/
+    void giveBack(std::size_t sizeClass, FreeList& src, std::size_t count) {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        FreeList& dest = m_lists[sizeClass];
+        for(std::size_t i=0 ; i<count && src.count > 0 ; ++i) {
+            dest.push(src.pop());
+        }
+    }
+
+    /** @brief Allocates a new chunk and splits it into blocks of the given size class*/
+    void newChunk(std::size_t sizeClass, FreeList& dest) {
+        char* pChunk = static_cast<char*>(::operator new(chunkSize));
+        {
+            std::unique_lock<std::mutex> lck(m_mtx);
+            m_chunks.push_back(pChunk);
+        }
+        std::size_t blockSize = blockSizeOf(sizeClass);
+        for(std::size_t offset = 0 ; offset + blockSize <= chunkSize ; offset += blockSize) {
+            dest.push(reinterpret_cast<FreeBlock*>(pChunk + offset));
+        }
+    }
+
+private:
+    std::mutex m_mtx;
+    FreeList m_lists[nrSizeClasses];
+    std::vector<char*> m_chunks;
+};
+
+/** @brief Never destroyed, because thread pools owned by static objects may still free blocks during static destruction*/
+SharedLists& sharedLists() {
+    static SharedLists* pLists = new SharedLists;
+    return *pLists;
+}
+
+thread_local bool isThreadCacheDestroyed = false;
+
+class ThreadCache {
+public:
+    ~ThreadCache() {
+        for(std::size_t i=0 ; i<nrSizeClasses ; ++i) {
+            if(m_lists[i].count > 0) {
+                sharedLists().giveBack(i, m_lists[i], m_lists[i].count);
+            }
+        }
+        isThreadCacheDestroyed = true;
+    }
+
+    void* allocate(std::size_t sizeClass) {
+        FreeList& list = m_lists[sizeClass];
+        if(list.count == 0 && !sharedLists().takeBatch(sizeClass, list)) {
+            sharedLists().newChunk(sizeClass, list);
+        }
+        return list.pop();
+    }
+
+    void deallocate(void* p, std::size_t sizeClass) {
+        FreeList& list = m_lists[sizeClass];
+        list.push(static_cast<FreeBlock*>(p));
+        if(list.count > maxLocalBlocks) {
+            sharedLists().giveBack(sizeClass, list, list.count - maxLocalBlocks / 2);
+        }
+    }
+
+private:
+    FreeList m_lists[nrSizeClasses];
+};
+
+thread_local ThreadCache threadCache;
+
+} // namespace
+
+std::pmr::memory_resource* currentMemoryResource() noexcept {
+    return currentResource;
+}
+
+std::pmr::memory_resource* setCurrentMemoryResource(std::pmr::memory_resource* pResource) noexcept {
+    std::pmr::memory_resource* pPrevious = currentResource;
+    currentResource = pResource;
+    return pPrevious;
+}
+
+void* ThreadLocalPoolResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+    if(!isPooled(bytes, alignment)) {
+        return ::operator new(bytes, std::align_val_t(alignment));
+    }
+    if(isThreadCacheDestroyed) {
+        // the thread is exiting; go directly to the shared lists
+        FreeList list;
+        std::size_t sizeClass = sizeClassOf(bytes);
+        if(!sharedLists().takeBatch(sizeClass, list)) {
+            sharedLists().newChunk(sizeClass, list);
+        }
+        void* p = list.pop();
+        sharedLists().giveBack(sizeClass, list, list.count);
+        return p;
+    }
+    return threadCache.allocate(sizeClassOf(bytes));
+}
+
+void ThreadLocalPoolResource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment) {
+    if(!isPooled(bytes, alignment)) {
+        ::operator delete(p, bytes, std::align_val_t(alignment));
+        return;
+    }
+    if(isThreadCacheDestroyed) {
+        FreeList list;
+        list.push(static_cast<FreeBlock*>(p));
+        sharedLists().giveBack(sizeClassOf(bytes), list, 1);
+        return;
+    }
+    threadCache.deallocate(p, sizeClassOf(bytes));
+}
+
+bool ThreadLocalPoolResource::do_is_equal(std::pmr::memory_resource const& other) const noexcept {
+    return this == &other;
+}
+
+ThreadLocalPoolResource* threadLocalPoolResource() noexcept {
+    static ThreadLocalPoolResource* pResource = new ThreadLocalPoolResource;
+    return pResource;
+}
+
+} // namespace carpal
@@ -0,0 +1,54 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/ShardedAlarmClock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+std::atomic<unsigned> nextThreadIndex{0};
+
+/** @brief A number identifying the current thread, assigned in round-robin order; the shard is this number modulo the number
+ * of shards, so threads spread over the shards of any sharded clock.*/
+thread_local unsigned currentThreadIndex = nextThreadIndex.fetch_add(1, std::memory_order_relaxed);
+
+} // namespace
+
+namespace carpal {
+
+ShardedAlarmClock::ShardedAlarmClock(unsigned nrShards, AlarmClock::Backend backend, std::chrono::nanoseconds tick) {
+    if(nrShards == 0) {
+        nrShards = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_shards.reserve(nrShards);
+    for(unsigned i=0 ; i<nrShards ; ++i) {
+        m_shards.push_back(std::make_unique<AlarmClock>(backend, tick));
+    }
+}
+
+AlarmClock& ShardedAlarmClock::currentShard() {
+    return *m_shards[currentThreadIndex % m_shards.size()];
+}
+
+void ShardedAlarmClock::close() {
+    for(auto& pShard : m_shards) {
+        pShard->close();
+    }
+}
+
+void ShardedAlarmClock::setDefaultSlack(std::chrono::nanoseconds slack) {
+    for(auto& pShard : m_shards) {
+        pShard->setDefaultSlack(slack);
+    }
+}
+
+ShardedAlarmClock* shardedAlarmClock() {
+    static ShardedAlarmClock clock;
+    return &clock;
+}
+
+} // namespace carpal
@@ -6,7 +6,21 @@
 
 #include <assert.h>
 
-carpal::ThreadPool::ThreadPool(unsigned nrThreads) {
+namespace {
+
+/** @brief The pool the current thread belongs to, if any*/
+thread_local carpal::ThreadPool const* currentPool = nullptr;
+
+} // namespace
+
+carpal::ThreadPool::ThreadPool(unsigned nrThreads)
+    :ThreadPool(nrThreads, 0, OverflowPolicy::block)
+{}
+
+carpal::ThreadPool::ThreadPool(unsigned nrThreads, size_t capacity, OverflowPolicy policy)
+    :m_capacity(capacity)
+    ,m_policy(policy)
+{
     m_threads.reserve(nrThreads);
     for(unsigned i=0 ; i<nrThreads ; ++i) {
         m_threads.emplace_back(&ThreadPool::threadFunction, this);
@@ -20,24 +34,54 @@ carpal::ThreadPool::~ThreadPool() {
     }
 }
 
-void carpal::ThreadPool::enqueue(std::function<void()> func) {
+void carpal::ThreadPool::enqueue(Runnable func) {
+    if(!tryEnqueue(func)) {
+        throw ExecutorRejectedException();
+    }
+}
+
+bool carpal::ThreadPool::tryEnqueue(Runnable& func) {
     std::unique_lock<std::mutex> lck(m_mtx);
+    if(m_capacity != 0 && m_tasks.size() >= m_capacity && currentPool != this) {
+        switch(m_policy) {
+        case OverflowPolicy::block:
+            m_cvNotFull.wait(lck, [this]() { return m_tasks.size() < m_capacity || m_isClosed; });
+            if(m_isClosed) {
+                // the threads may be gone already, so the task would never run
+                return false;
+            }
+            break;
+        case OverflowPolicy::reject:
+            return false;
+        case OverflowPolicy::runInCaller:
+            lck.unlock();
+            func();
+            func.reset();
+            return true;
+        }
+    }
     m_tasks.push_back(std::move(func));
     m_cv.notify_one();
+    return true;
 }
 
 void carpal::ThreadPool::close() {
     std::unique_lock<std::mutex> lck(m_mtx);
     m_isClosed = true;
     m_cv.notify_all();
+    m_cvNotFull.notify_all();
 }
 
 void carpal::ThreadPool::threadFunction() {
+    currentPool = this;
     std::unique_lock<std::mutex> lck(m_mtx);
     while(true) {
         if(!m_tasks.empty()) {
-            std::function<void()> func = std::move(m_tasks.front());
+            Runnable func = std::move(m_tasks.front());
             m_tasks.pop_front();
+            if(m_capacity != 0) {
+                m_cvNotFull.notify_one();
+            }
             lck.unlock();
             try {
                 func();
@@ -3,38 +3,37 @@
 // (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
 
 #include "carpal/Timer.h"
+#include "TimerStore.h"
+
+#include <algorithm>
 
 #include <assert.h>
 
 namespace carpal {
 
-namespace carpal_private {
+namespace {
 
-class TimerFutureObject : public PromiseFuturePair<bool> {
-public:
-    explicit TimerFutureObject(std::chrono::system_clock::time_point const& when, AlarmClock* pClock)
-        :m_when(when)
-        ,m_pClock(pClock)
-    {
-        // nothing else
-    }
-private:
-    friend AlarmClock;
-    friend Timer;
-    void trigger() {
-        if(!this->isComplete()) {
-            this->set(true);
-        }
+std::chrono::steady_clock::time_point toSteady(std::chrono::system_clock::time_point when) {
+    // reading the wall clock first means the timer cannot fire early because of the delay between the two readings
+    std::chrono::system_clock::time_point systemNow = std::chrono::system_clock::now();
+    std::chrono::steady_clock::time_point steadyNow = std::chrono::steady_clock::now();
+    if(when <= systemNow) {
+        // computing the difference could overflow for a time point far in the past
+        return steadyNow;
+    }
+    std::chrono::system_clock::duration delta = when - systemNow;
+    std::chrono::steady_clock::duration maxDelta = std::chrono::steady_clock::time_point::max() - steadyNow;
+    if(delta >= std::chrono::duration_cast<std::chrono::system_clock::duration>(maxDelta)) {
+        // far in the future, such as system_clock::time_point::max(); the timer never fires
+        return std::chrono::steady_clock::time_point::max();
     }
-    
-    std::chrono::system_clock::time_point m_when;
-    AlarmClock* m_pClock;
-};    
+    return steadyNow + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delta);
+}
 
-} // namespace carpal_private
+} // namespace
 
 Future<bool> Timer::getFuture() {
-    return Future<bool>(std::shared_ptr<PromiseFuturePair<bool> >(m_pFuture));
+    return Future<bool>(RefPtr<PromiseFuturePair<bool> >(m_pFuture));
 }
 
 void Timer::cancel() {
@@ -42,78 +41,241 @@ void Timer::cancel() {
 }
 
 AlarmClock::AlarmClock()
-    :m_timers(&AlarmClock::compareTimers)
-    ,m_thread(&AlarmClock::threadFunction, this)
+    :AlarmClock(Backend::orderedSet)
 {
     // empty
 }
 
+AlarmClock::AlarmClock(Backend backend, std::chrono::nanoseconds tick)
+{
+    if(backend == Backend::timingWheel) {
+        m_pTimers = std::make_unique<carpal_private::TimingWheelTimerStore>(tick);
+    } else {
+        m_pTimers = std::make_unique<carpal_private::OrderedTimerStore>();
+    }
+    m_thread = std::thread(&AlarmClock::threadFunction, this);
+}
+
 AlarmClock::~AlarmClock() {
     close();
+    // joined first, so that no execution gets dispatched after the wait
     m_thread.join();
+    std::unique_lock<std::mutex> lck(m_mtx);
+    m_executionsDone.wait(lck, [this]() {return m_nrExecutions == 0;});
 }
 
 void AlarmClock::close() {
-    std::unique_lock<std::mutex> lck(m_mtx);
-    m_closed = true;
-    m_cond.notify_all();
+    std::vector<RefPtr<carpal_private::TimerFutureObject> > pending;
+    {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        m_closed = true;
+        m_pTimers->popAll(pending);
+        m_cond.notify_all();
+    }
+    for(auto& pTimer : pending) {
+        pTimer->complete(false);
+    }
+}
+
+Timer AlarmClock::setTimer(std::chrono::steady_clock::time_point when) {
+    return addTimer(when, std::nullopt);
 }
 
 Timer AlarmClock::setTimer(std::chrono::system_clock::time_point when) {
-    std::shared_ptr<carpal_private::TimerFutureObject> ret = std::make_shared<carpal_private::TimerFutureObject>(when, this);
+    return addTimer(toSteady(when), std::nullopt);
+}
+
+Timer AlarmClock::setTimerAfter(std::chrono::steady_clock::duration delta) {
+    return addTimer(std::chrono::steady_clock::now() + delta, std::nullopt);
+}
+
+Timer AlarmClock::setTimer(std::chrono::steady_clock::time_point when, std::chrono::nanoseconds slack) {
+    return addTimer(when, slack);
+}
+
+Timer AlarmClock::setTimer(std::chrono::system_clock::time_point when, std::chrono::nanoseconds slack) {
+    return addTimer(toSteady(when), slack);
+}
+
+Timer AlarmClock::setTimerAfter(std::chrono::steady_clock::duration delta, std::chrono::nanoseconds slack) {
+    return addTimer(std::chrono::steady_clock::now() + delta, slack);
+}
+
+void AlarmClock::setDefaultSlack(std::chrono::nanoseconds slack) {
     std::unique_lock<std::mutex> lck(m_mtx);
-    auto it = m_timers.emplace(ret).first;
-    if(it == m_timers.begin()) {
-        m_cond.notify_all();
-    }
+    m_defaultSlack = std::max(slack, std::chrono::nanoseconds(0));
+}
+
+Timer AlarmClock::addTimer(std::chrono::steady_clock::time_point when, std::optional<std::chrono::nanoseconds> slack) {
+    RefPtr<carpal_private::TimerFutureObject> ret = makeRefCounted<carpal_private::TimerFutureObject>(
+        when, std::max(slack.value_or(std::chrono::nanoseconds(0)), std::chrono::nanoseconds(0)), this);
+    insertTimer(ret, !slack.has_value());
     return Timer(ret);
 }
 
-void AlarmClock::cancelTimer(std::shared_ptr<carpal_private::TimerFutureObject> pTimerObject) {
-    assert(pTimerObject->m_pClock == this);
-    std::unique_lock<std::mutex> lck(m_mtx);
-    if(!pTimerObject->isComplete()) {
-        pTimerObject->set(false);
+void AlarmClock::insertTimer(RefPtr<carpal_private::TimerFutureObject> const& pTimer, bool useDefaultSlack) {
+    carpal_private::CancellationState* pCancellationState = pTimer->cancellationState();
+    if(pCancellationState != nullptr) {
+        // Registered before the timer can fire, so that completing the timer always finds the callback to remove. The flag is
+        // set first, since the callback may complete the timer as soon as it is registered.
+        pTimer->m_isWatchingCancellation = true;
+        if(!pCancellationState->addCallback([this, pTimer]() {cancelTimer(pTimer);}, pTimer->m_cancellationCallback)) {
+            pTimer->m_isWatchingCancellation = false;
+            pTimer->complete(false);
+            return;
+        }
     }
-    auto it = m_timers.find(pTimerObject);
-    if(it == m_timers.begin() || m_nextTimer == pTimerObject) {
-        m_cond.notify_all();
+    {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        if(pTimer->m_isDone.load(std::memory_order_acquire)) {
+            // canceled already; see cancelTimer()
+            return;
+        }
+        if(!m_closed) {
+            if(useDefaultSlack) {
+                pTimer->m_slack = m_defaultSlack;
+            }
+            if(m_pTimers->insert(pTimer)) {
+                m_cond.notify_all();
+            }
+            return;
+        }
+    }
+    pTimer->complete(false);
+}
+
+Timer AlarmClock::setPeriodicTimer(std::chrono::steady_clock::time_point first, std::chrono::steady_clock::duration period,
+        Executor* pExecutor, Runnable func, Schedule schedule) {
+    RefPtr<carpal_private::TimerFutureObject> ret = makeRefCounted<carpal_private::PeriodicTimerObject>(
+        first, period, schedule, pExecutor, std::move(func), this);
+    insertTimer(ret, true);
+    return Timer(ret);
+}
+
+void AlarmClock::rearmTimer(RefPtr<carpal_private::TimerFutureObject> const& pTimer, std::chrono::steady_clock::time_point when) {
+    {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        if(!m_closed && !pTimer->m_isDone.load(std::memory_order_acquire)) {
+            pTimer->m_when = when;
+            if(m_pTimers->insert(pTimer)) {
+                m_cond.notify_all();
+            }
+            return;
+        }
     }
-    if(it != m_timers.end()) {
-        m_timers.erase(it);
+    pTimer->complete(false);
+}
+
+void AlarmClock::cancelTimer(RefPtr<carpal_private::TimerFutureObject> pTimerObject) {
+    assert(pTimerObject->m_pClock == this);
+    // The clock thread may be triggering it concurrently, if it has just expired; only one of them wins. Claiming under the
+    // lock keeps a concurrent insertTimer() or rearmTimer() from putting the timer back into the store; and, when called from
+    // the cancellation callback, the clock is not used afterwards, so whoever completes the timer meanwhile may destroy it.
+    bool isClaimed;
+    {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        m_pTimers->remove(pTimerObject.get());
+        isClaimed = !pTimerObject->m_isDone.exchange(true, std::memory_order_acq_rel);
     }
-    if(m_nextTimer == pTimerObject) {
-        m_nextTimer = nullptr;
+    if(isClaimed) {
+        pTimerObject->stopWatchingCancellation();
+        pTimerObject->set(false);
     }
 }
 
-bool AlarmClock::compareTimers(std::shared_ptr<carpal_private::TimerFutureObject> const& p,
-    std::shared_ptr<carpal_private::TimerFutureObject> const& q) {
-        return ((p->m_when < q->m_when) || (p->m_when == q->m_when && p < q));
+void AlarmClock::beginExecution() {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    ++m_nrExecutions;
+}
+
+void AlarmClock::endExecution() {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    if(--m_nrExecutions == 0) {
+        m_executionsDone.notify_all();
+    }
 }
 
 void AlarmClock::threadFunction() {
+    std::vector<RefPtr<carpal_private::TimerFutureObject> > expired;
     std::unique_lock<std::mutex> lck(m_mtx);
     while(true) {
-        if(m_timers.empty()) {
+        if(m_pTimers->empty()) {
             if(m_closed) return;
             m_cond.wait(lck);
-        } else {
-            m_nextTimer = *(m_timers.begin());
-            auto result = m_cond.wait_until(lck, m_nextTimer->m_when);
-            if(result == std::cv_status::timeout) {
-                while(!m_timers.empty() && (*m_timers.begin())->m_when <= m_nextTimer->m_when) {
-                    (*m_timers.begin())->trigger();
-                    m_timers.erase(m_timers.begin());
-                }
-                m_nextTimer.reset();
-            } else {
-                m_nextTimer.reset();
-            }
+            continue;
+        }
+        std::chrono::steady_clock::time_point deadline = m_pTimers->nextDeadline();
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(deadline > now) {
+            m_cond.wait_until(lck, deadline);
+            continue;
+        }
+        m_pTimers->popExpired(now, expired);
+        // the continuations run on this thread, and they may set or cancel timers
+        lck.unlock();
+        for(auto& pTimer : expired) {
+            pTimer->trigger();
+        }
+        expired.clear();
+        lck.lock();
+    }
+}
+
+namespace carpal_private {
+
+PeriodicTimerObject::PeriodicTimerObject(std::chrono::steady_clock::time_point const& first, std::chrono::steady_clock::duration period,
+        AlarmClock::Schedule schedule, Executor* pExecutor, Runnable func, AlarmClock* pClock)
+    :TimerFutureObject(first, std::chrono::nanoseconds(0), pClock)
+    ,m_period(std::max(period, std::chrono::steady_clock::duration(1)))
+    ,m_schedule(schedule)
+    ,m_pExecutor(pExecutor)
+    ,m_func(std::move(func))
+{}
+
+void PeriodicTimerObject::trigger() {
+    // canceled while the previous execution was running, and re-armed before noticing
+    if(m_isDone.load(std::memory_order_acquire)) return;
+    Runnable task([pThis=RefPtr<PeriodicTimerObject>(this)]() {
+        pThis->execute();
+        // last, since the clock may get destroyed as soon as the count drops
+        pThis->m_pClock->endExecution();
+    });
+    m_pClock->beginExecution();
+    if(!m_pExecutor->tryEnqueue(task)) {
+        fail(std::make_exception_ptr(ExecutorRejectedException()));
+        m_pClock->endExecution();
+    }
+}
+
+void PeriodicTimerObject::execute() {
+    if(m_isDone.load(std::memory_order_acquire)) return;
+    try {
+        m_func();
+    } catch(...) {
+        fail(std::current_exception());
+        return;
+    }
+    std::chrono::steady_clock::time_point next;
+    if(m_schedule == AlarmClock::Schedule::fixedRate) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        next = m_when + m_period;
+        if(next <= now) {
+            next += ((now - next) / m_period + 1) * m_period;
         }
+    } else {
+        next = std::chrono::steady_clock::now() + m_period;
     }
+    m_pClock->rearmTimer(RefPtr<TimerFutureObject>(this), next);
 }
 
+void PeriodicTimerObject::fail(std::exception_ptr exception) {
+    if(claimCompletion()) {
+        this->setException(exception);
+    }
+}
+
+} // namespace carpal_private
+
 AlarmClock* alarmClock() {
     static AlarmClock alarmClock;
     return &alarmClock;
@@ -0,0 +1,258 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "TimerStore.h"
+
+#include <assert.h>
+
+namespace carpal {
+namespace carpal_private {
+
+namespace {
+
+unsigned highestBit(uint64_t v) {
+    return 63 - static_cast<unsigned>(__builtin_clzll(v));
+}
+
+unsigned lowestBit(uint64_t v) {
+    return static_cast<unsigned>(__builtin_ctzll(v));
+}
+
+} // namespace
+
+OrderedTimerStore::OrderedTimerStore()
+    :m_timers(&OrderedTimerStore::compareTimers)
+{}
+
+bool OrderedTimerStore::compareTimers(RefPtr<TimerFutureObject> const& p, RefPtr<TimerFutureObject> const& q) {
+    TimePoint pLatest = p->latest();
+    TimePoint qLatest = q->latest();
+    return ((pLatest < qLatest) || (pLatest == qLatest && p.get() < q.get()));
+}
+
+bool OrderedTimerStore::insert(RefPtr<TimerFutureObject> pTimer) {
+    auto it = m_timers.emplace(std::move(pTimer)).first;
+    return it == m_timers.begin();
+}
+
+void OrderedTimerStore::remove(TimerFutureObject* pTimer) {
+    auto it = m_timers.find(RefPtr<TimerFutureObject>(pTimer));
+    if(it != m_timers.end()) {
+        m_timers.erase(it);
+    }
+}
+
+bool OrderedTimerStore::empty() const {
+    return m_timers.empty();
+}
+
+TimerStore::TimePoint OrderedTimerStore::nextDeadline() {
+    return (*m_timers.begin())->latest();
+}
+
+void OrderedTimerStore::popExpired(TimePoint now, std::vector<RefPtr<TimerFutureObject> >& expired) {
+    // The timers are ordered by the latest time they may fire at. Stopping at the first timer not due yet still fires all the
+    // timers whose latest time has passed, since those come first.
+    while(!m_timers.empty() && (*m_timers.begin())->m_when <= now) {
+        expired.push_back(std::move(m_timers.extract(m_timers.begin()).value()));
+    }
+}
+
+void OrderedTimerStore::popAll(std::vector<RefPtr<TimerFutureObject> >& timers) {
+    while(!m_timers.empty()) {
+        timers.push_back(std::move(m_timers.extract(m_timers.begin()).value()));
+    }
+}
+
+TimingWheelTimerStore::TimingWheelTimerStore(std::chrono::nanoseconds tick)
+    :m_origin(std::chrono::steady_clock::now())
+    ,m_tick(tick.count() > 0 ? tick : std::chrono::nanoseconds(1))
+{}
+
+TimingWheelTimerStore::~TimingWheelTimerStore() {
+    for(int bucket=0 ; bucket<nrBuckets ; ++bucket) {
+        while(TimerFutureObject* pTimer = m_buckets[bucket]) {
+            unlink(pTimer);
+            pTimer->release();
+        }
+    }
+}
+
+uint64_t TimingWheelTimerStore::tickAtOrAfter(TimePoint when) const {
+    if(when <= m_origin) return 0;
+    uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(when - m_origin).count());
+    uint64_t tick = static_cast<uint64_t>(m_tick.count());
+    return ns / tick + (ns % tick != 0 ? 1 : 0);
+}
+
+uint64_t TimingWheelTimerStore::tickAtOrBefore(TimePoint when) const {
+    if(when <= m_origin) return 0;
+    uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(when - m_origin).count());
+    return ns / static_cast<uint64_t>(m_tick.count());
+}
+
+TimerStore::TimePoint TimingWheelTimerStore::timeOfTick(uint64_t tick) const {
+    uint64_t maxTick = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(TimePoint::max() - m_origin).count())
+        / static_cast<uint64_t>(m_tick.count());
+    if(tick >= maxTick) return TimePoint::max();
+    return m_origin + std::chrono::duration_cast<TimePoint::duration>(m_tick * tick);
+}
+
+uint64_t TimingWheelTimerStore::expiryTick(TimerFutureObject const* pTimer) const {
+    uint64_t earliest = tickAtOrAfter(pTimer->m_when);
+    uint64_t latest = tickAtOrBefore(pTimer->latest());
+    if(latest <= earliest) return earliest;
+    // Clear the low bits of the latest tick, as many as possible while staying within the interval. Timers with overlapping
+    // intervals tend to get the same tick, and so expire together.
+    uint64_t mask = (uint64_t(1) << highestBit(earliest ^ latest)) - 1;
+    return latest & ~mask;
+}
+
+void TimingWheelTimerStore::link(TimerFutureObject* pTimer, int bucket) {
+    TimerFutureObject*& pHead = m_buckets[bucket];
+    pTimer->m_pPrevInBucket = nullptr;
+    pTimer->m_pNextInBucket = pHead;
+    if(pHead != nullptr) {
+        pHead->m_pPrevInBucket = pTimer;
+    }
+    pHead = pTimer;
+    pTimer->m_bucket = bucket;
+    if(bucket < dueBucket) {
+        m_occupied[bucket / nrSlots] |= uint64_t(1) << (bucket % nrSlots);
+    }
+}
+
+void TimingWheelTimerStore::unlink(TimerFutureObject* pTimer) {
+    int bucket = pTimer->m_bucket;
+    assert(bucket >= 0);
+    if(pTimer->m_pPrevInBucket != nullptr) {
+        pTimer->m_pPrevInBucket->m_pNextInBucket = pTimer->m_pNextInBucket;
+    } else {
+        m_buckets[bucket] = pTimer->m_pNextInBucket;
+    }
+    if(pTimer->m_pNextInBucket != nullptr) {
+        pTimer->m_pNextInBucket->m_pPrevInBucket = pTimer->m_pPrevInBucket;
+    }
+    pTimer->m_pPrevInBucket = nullptr;
+    pTimer->m_pNextInBucket = nullptr;
+    pTimer->m_bucket = -1;
+    if(bucket < dueBucket && m_buckets[bucket] == nullptr) {
+        m_occupied[bucket / nrSlots] &= ~(uint64_t(1) << (bucket % nrSlots));
+    }
+}
+
+void TimingWheelTimerStore::place(TimerFutureObject* pTimer) {
+    uint64_t expiry = pTimer->m_expiryTick;
+    if(expiry <= m_currentTick) {
+        link(pTimer, dueBucket);
+        return;
+    }
+    unsigned level = highestBit(expiry ^ m_currentTick) / slotBits;
+    if(level >= nrLevels) {
+        link(pTimer, overflowBucket);
+        return;
+    }
+    unsigned slot = static_cast<unsigned>(expiry >> (level * slotBits)) & (nrSlots - 1);
+    link(pTimer, static_cast<int>(level * nrSlots + slot));
+}
+
+bool TimingWheelTimerStore::nextEventTick(uint64_t& tick, int& bucket) const {
+    // A timer on a level expires after the current tick, within the current slot of the level above; so, any candidate
+    // on a level comes before any candidate on a higher level.
+    for(unsigned level=0 ; level<nrLevels ; ++level) {
+        unsigned shift = level * slotBits;
+        unsigned index = static_cast<unsigned>(m_currentTick >> shift) & (nrSlots - 1);
+        uint64_t candidates = (index + 1 < nrSlots) ? (m_occupied[level] & (~uint64_t(0) << (index + 1))) : 0;
+        if(candidates == 0) continue;
+        unsigned slot = lowestBit(candidates);
+        unsigned highShift = shift + slotBits;
+        uint64_t high = (highShift >= 64) ? 0 : ((m_currentTick >> highShift) << highShift);
+        tick = high | (uint64_t(slot) << shift);
+        bucket = static_cast<int>(level * nrSlots + slot);
+        return true;
+    }
+    if(m_buckets[overflowBucket] != nullptr) {
+        unsigned topShift = nrLevels * slotBits;
+        tick = ((m_currentTick >> topShift) + 1) << topShift;
+        bucket = overflowBucket;
+        return true;
+    }
+    return false;
+}
+
+void TimingWheelTimerStore::advanceTo(uint64_t target) {
+    uint64_t tick;
+    int bucket;
+    while(nextEventTick(tick, bucket) && tick <= target) {
+        m_currentTick = tick;
+        while(TimerFutureObject* pTimer = m_buckets[bucket]) {
+            unlink(pTimer);
+            place(pTimer);
+        }
+    }
+    if(target > m_currentTick) {
+        m_currentTick = target;
+    }
+}
+
+bool TimingWheelTimerStore::insert(RefPtr<TimerFutureObject> pTimer) {
+    bool hadEvent = (m_buckets[dueBucket] != nullptr);
+    uint64_t previousTick = 0;
+    int bucket;
+    if(!hadEvent) {
+        hadEvent = nextEventTick(previousTick, bucket);
+    }
+    TimerFutureObject* p = pTimer.detach();
+    p->m_expiryTick = expiryTick(p);
+    place(p);
+    ++m_size;
+    if(!hadEvent || p->m_bucket == dueBucket) return true;
+    uint64_t newTick;
+    return nextEventTick(newTick, bucket) && newTick < previousTick;
+}
+
+void TimingWheelTimerStore::remove(TimerFutureObject* pTimer) {
+    if(pTimer->m_bucket < 0) return;
+    unlink(pTimer);
+    --m_size;
+    pTimer->release();
+}
+
+bool TimingWheelTimerStore::empty() const {
+    return m_size == 0;
+}
+
+TimerStore::TimePoint TimingWheelTimerStore::nextDeadline() {
+    if(m_buckets[dueBucket] != nullptr) {
+        return TimePoint::min();
+    }
+    uint64_t tick;
+    int bucket;
+    if(!nextEventTick(tick, bucket)) {
+        return TimePoint::max();
+    }
+    return timeOfTick(tick);
+}
+
+void TimingWheelTimerStore::popExpired(TimePoint now, std::vector<RefPtr<TimerFutureObject> >& expired) {
+    advanceTo(tickAtOrBefore(now));
+    while(TimerFutureObject* pTimer = m_buckets[dueBucket]) {
+        unlink(pTimer);
+        --m_size;
+        expired.push_back(RefPtr<TimerFutureObject>::adopt(pTimer));
+    }
+}
+
+void TimingWheelTimerStore::popAll(std::vector<RefPtr<TimerFutureObject> >& timers) {
+    for(int bucket=0 ; bucket<nrBuckets ; ++bucket) {
+        while(TimerFutureObject* pTimer = m_buckets[bucket]) {
+            unlink(pTimer);
+            --m_size;
+            timers.push_back(RefPtr<TimerFutureObject>::adopt(pTimer));
+        }
+    }
+}
+
+} // namespace carpal_private
+} // namespace carpal
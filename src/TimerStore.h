@@ -0,0 +1,118 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include "carpal/Timer.h"
+
+#include <set>
+#include <vector>
+
+namespace carpal {
+namespace carpal_private {
+
+/** @brief [Internal use] The set of pending timers of an @c AlarmClock. All functions are called under the clock lock.
+ *
+ * The store holds a reference to each timer it contains.*/
+class TimerStore {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    virtual ~TimerStore() {}
+
+    /** @brief Adds a timer. Returns true if the next deadline moved earlier, so that the clock thread must wake up.*/
+    virtual bool insert(RefPtr<TimerFutureObject> pTimer) = 0;
+
+    /** @brief Removes a timer, if present.*/
+    virtual void remove(TimerFutureObject* pTimer) = 0;
+
+    virtual bool empty() const = 0;
+
+    /** @brief Returns the time when the clock thread needs to wake up next; must not be called on an empty store.
+     * Timers never expire before their deadline, but the store may ask to be woken up earlier, for housekeeping.*/
+    virtual TimePoint nextDeadline() = 0;
+
+    /** @brief Removes the timers expired at the given time, and appends them to @c expired*/
+    virtual void popExpired(TimePoint now, std::vector<RefPtr<TimerFutureObject> >& expired) = 0;
+
+    /** @brief Removes all the timers, and appends them to @c timers*/
+    virtual void popAll(std::vector<RefPtr<TimerFutureObject> >& timers) = 0;
+};
+
+/** @brief [Internal use] Timers kept in a tree, ordered by deadline*/
+class OrderedTimerStore : public TimerStore {
+public:
+    OrderedTimerStore();
+    bool insert(RefPtr<TimerFutureObject> pTimer) override;
+    void remove(TimerFutureObject* pTimer) override;
+    bool empty() const override;
+    TimePoint nextDeadline() override;
+    void popExpired(TimePoint now, std::vector<RefPtr<TimerFutureObject> >& expired) override;
+    void popAll(std::vector<RefPtr<TimerFutureObject> >& timers) override;
+
+private:
+    static bool compareTimers(RefPtr<TimerFutureObject> const& p, RefPtr<TimerFutureObject> const& q);
+
+    std::set<RefPtr<TimerFutureObject>, decltype(&OrderedTimerStore::compareTimers)> m_timers;
+};
+
+/** @brief [Internal use] A hierarchical timing wheel.
+ *
+ * Time is divided into ticks, counted from the creation of the wheel; a timer expires at the first tick not earlier than its
+ * deadline, or, if it has some slack, at the roundest tick within the slack. There are @c nrLevels levels of @c nrSlots slots each; a timer sits on the level of the most significant group of
+ * @c slotBits bits where its expiry tick differs from the current tick, in the slot given by that group of its expiry tick. When the
+ * current tick reaches the start of a slot on a higher level, the timers there are moved to the lower levels (cascading). Timers
+ * beyond the range of the top level wait in an overflow list. Each slot is an intrusive doubly linked list, so adding and removing
+ * a timer is O(1); a bitmap of the non-empty slots on each level lets finding the next deadline be O(nrLevels).*/
+class TimingWheelTimerStore : public TimerStore {
+public:
+    static constexpr unsigned slotBits = 6;
+    static constexpr unsigned nrSlots = 1u << slotBits;
+    static constexpr unsigned nrLevels = 6;
+
+    explicit TimingWheelTimerStore(std::chrono::nanoseconds tick);
+    ~TimingWheelTimerStore() override;
+    bool insert(RefPtr<TimerFutureObject> pTimer) override;
+    void remove(TimerFutureObject* pTimer) override;
+    bool empty() const override;
+    TimePoint nextDeadline() override;
+    void popExpired(TimePoint now, std::vector<RefPtr<TimerFutureObject> >& expired) override;
+    void popAll(std::vector<RefPtr<TimerFutureObject> >& timers) override;
+
+private:
+    /** @brief Index of the list of timers whose expiry tick was reached when they were inserted or cascaded*/
+    static constexpr int dueBucket = nrLevels * nrSlots;
+    static constexpr int overflowBucket = dueBucket + 1;
+    static constexpr int nrBuckets = overflowBucket + 1;
+
+    /** @brief Returns the first tick not earlier than the given time point*/
+    uint64_t tickAtOrAfter(TimePoint when) const;
+    /** @brief Returns the last tick not later than the given time point*/
+    uint64_t tickAtOrBefore(TimePoint when) const;
+    TimePoint timeOfTick(uint64_t tick) const;
+    /** @brief Chooses the tick the timer expires at, within the interval allowed by its slack*/
+    uint64_t expiryTick(TimerFutureObject const* pTimer) const;
+
+    /** @brief Places the timer in the bucket matching its expiry tick, relative to the current tick*/
+    void place(TimerFutureObject* pTimer);
+    void link(TimerFutureObject* pTimer, int bucket);
+    void unlink(TimerFutureObject* pTimer);
+
+    /** @brief Finds the earliest tick at which a non-empty slot must be processed; returns false if there are none
+     * (the due list is not considered).*/
+    bool nextEventTick(uint64_t& tick, int& bucket) const;
+
+    /** @brief Advances the current tick up to the given one, cascading and moving expired timers into the due list*/
+    void advanceTo(uint64_t tick);
+
+    TimePoint m_origin;
+    std::chrono::nanoseconds m_tick;
+    uint64_t m_currentTick = 0;
+    size_t m_size = 0;
+    TimerFutureObject* m_buckets[nrBuckets] = {};
+    uint64_t m_occupied[nrLevels] = {};
+};
+
+} // namespace carpal_private
+} // namespace carpal
@@ -0,0 +1,308 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/WorkStealingCoroutineScheduler.h"
+#include "carpal/WorkStealingDeque.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace carpal {
+
+namespace {
+
+std::atomic<uint64_t> nextSchedulerId{1};
+
+/** @brief The id of the scheduler the cached participant belongs to; 0 if none. Ids are never reused, so an entry for a
+ * destroyed scheduler never matches again.*/
+thread_local uint64_t cachedSchedulerId = 0;
+thread_local void* cachedParticipant = nullptr;
+
+} // namespace
+
+namespace carpal_private {
+
+/** @brief [Internal use] Lets the exiting threads reach a @c WorkStealingCoroutineScheduler, as long as it is alive*/
+class ThreadExitHook {
+public:
+    explicit ThreadExitHook(std::function<void(std::thread::id)> onThreadExit)
+        :m_onThreadExit(std::move(onThreadExit))
+    {}
+
+    void onThreadExit(std::thread::id tid) {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        if(m_onThreadExit) {
+            m_onThreadExit(tid);
+        }
+    }
+
+    /** @brief Called by the destructor of the scheduler; waits for the threads exiting right now*/
+    void detach() {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        m_onThreadExit = nullptr;
+    }
+
+    bool isDetached() {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        return !m_onThreadExit;
+    }
+
+private:
+    std::mutex m_mtx;
+    std::function<void(std::thread::id)> m_onThreadExit;
+};
+
+} // namespace carpal_private
+
+namespace {
+
+/** @brief The hooks of the schedulers the current thread participates in, called when the thread exits*/
+class ThreadExitHooks {
+public:
+    ~ThreadExitHooks() {
+        std::thread::id tid = std::this_thread::get_id();
+        for(auto const& pHook : m_hooks) {
+            pHook->onThreadExit(tid);
+        }
+    }
+
+    void add(std::shared_ptr<carpal_private::ThreadExitHook> pHook) {
+        // the hooks of the destroyed schedulers are dropped here, so they do not pile up on a long-lived thread
+        m_hooks.erase(std::remove_if(m_hooks.begin(), m_hooks.end(), [](auto const& p) {return p->isDetached();}), m_hooks.end());
+        m_hooks.push_back(std::move(pHook));
+    }
+
+private:
+    std::vector<std::shared_ptr<carpal_private::ThreadExitHook> > m_hooks;
+};
+
+thread_local ThreadExitHooks threadExitHooks;
+
+} // namespace
+
+class WorkStealingCoroutineScheduler::Participant {
+public:
+    explicit Participant(unsigned seed)
+        :m_rand(seed * 2654435761u + 1)
+    {}
+
+    /** @brief Returns a pseudo-random number, used for choosing the steal victim (xorshift)*/
+    unsigned nextRandom() noexcept {
+        m_rand ^= m_rand << 13;
+        m_rand ^= m_rand >> 17;
+        m_rand ^= m_rand << 5;
+        return m_rand;
+    }
+
+    /** @brief Coroutine frame addresses; used only if the participant is stealable*/
+    WorkStealingDeque<void*> m_tasks;
+    bool m_isStealable = false;
+    /** @brief Set by @c markThreadRunnable()*/
+    std::atomic<bool> m_isThreadRunnable{false};
+    /** @brief True if the thread of the participant will release it on exit; protected by the scheduler mutex*/
+    bool m_isReleasedOnExit = false;
+    bool m_isIdle = false; ///< @brief protected by the scheduler mutex
+
+    std::mutex m_parkMtx;
+    std::condition_variable m_parkCv;
+    bool m_wakeup = false; ///< @brief protected by m_parkMtx
+
+private:
+    unsigned m_rand;
+};
+
+WorkStealingCoroutineScheduler::WorkStealingCoroutineScheduler(unsigned maxStealableThreads)
+    :m_id(nextSchedulerId.fetch_add(1))
+    ,m_maxStealableThreads(maxStealableThreads)
+    ,m_stealable(new std::atomic<Participant*>[maxStealableThreads])
+    ,m_pExitHook(std::make_shared<carpal_private::ThreadExitHook>([this](std::thread::id tid) {
+        releaseParticipant(tid);
+    }))
+{
+    for(unsigned i=0 ; i<maxStealableThreads ; ++i) {
+        m_stealable[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+WorkStealingCoroutineScheduler::~WorkStealingCoroutineScheduler() {
+    m_pExitHook->detach();
+}
+
+WorkStealingCoroutineScheduler::Participant& WorkStealingCoroutineScheduler::participantFor(std::thread::id tid) {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    Participant*& pParticipant = m_participants[tid];
+    if(pParticipant == nullptr) {
+        if(!m_freeParticipants.empty()) {
+            // preferably, the stealable queue of an exited thread, with the coroutines left in it, goes to the new thread
+            auto it = std::find_if(m_freeParticipants.begin(), m_freeParticipants.end(), [](Participant* p) {
+                return p->m_isStealable;
+            });
+            if(it == m_freeParticipants.end()) {
+                it = m_freeParticipants.begin();
+            }
+            pParticipant = *it;
+            m_freeParticipants.erase(it);
+            return *pParticipant;
+        }
+        m_allParticipants.push_back(std::make_unique<Participant>(static_cast<unsigned>(m_allParticipants.size())));
+        pParticipant = m_allParticipants.back().get();
+        unsigned index = m_nrStealable.load(std::memory_order_relaxed);
+        if(index < m_maxStealableThreads) {
+            pParticipant->m_isStealable = true;
+            m_stealable[index].store(pParticipant, std::memory_order_release);
+            m_nrStealable.store(index + 1, std::memory_order_release);
+        }
+    }
+    return *pParticipant;
+}
+
+void WorkStealingCoroutineScheduler::releaseParticipant(std::thread::id tid) {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    auto it = m_participants.find(tid);
+    if(it == m_participants.end()) return;
+    Participant* pParticipant = it->second;
+    m_participants.erase(it);
+    pParticipant->m_isThreadRunnable.store(false);
+    pParticipant->m_isReleasedOnExit = false;
+    // not destroyed, since other threads may still refer to it
+    m_freeParticipants.push_back(pParticipant);
+}
+
+WorkStealingCoroutineScheduler::Participant& WorkStealingCoroutineScheduler::currentParticipant() {
+    if(cachedSchedulerId != m_id) {
+        Participant& participant = participantFor(std::this_thread::get_id());
+        bool isHookNeeded;
+        {
+            std::unique_lock<std::mutex> lck(m_mtx);
+            isHookNeeded = !participant.m_isReleasedOnExit;
+            participant.m_isReleasedOnExit = true;
+        }
+        if(isHookNeeded) {
+            threadExitHooks.add(m_pExitHook);
+        }
+        cachedParticipant = &participant;
+        cachedSchedulerId = m_id;
+    }
+    return *static_cast<Participant*>(cachedParticipant);
+}
+
+void WorkStealingCoroutineScheduler::markRunnable(std::coroutine_handle<void> h) {
+    if(cachedSchedulerId == m_id && static_cast<Participant*>(cachedParticipant)->m_isStealable) {
+        static_cast<Participant*>(cachedParticipant)->m_tasks.push(h.address());
+    } else {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        m_injected.push_back(h.address());
+        m_nrInjected.fetch_add(1);
+    }
+    wakeOne();
+}
+
+void WorkStealingCoroutineScheduler::markThreadRunnable(std::thread::id tid) {
+    Participant& participant = participantFor(tid);
+    participant.m_isThreadRunnable.store(true);
+    std::unique_lock<std::mutex> lck(participant.m_parkMtx);
+    participant.m_parkCv.notify_one();
+}
+
+void WorkStealingCoroutineScheduler::wakeOne() {
+    // pairs with the fence in schedule(): either we see the idle thread, or the idle thread sees the new task
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_nrIdle.load(std::memory_order_relaxed) == 0) return;
+    Participant* pParticipant = nullptr;
+    {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        if(m_idle.empty()) return;
+        pParticipant = m_idle.back();
+        m_idle.pop_back();
+        pParticipant->m_isIdle = false;
+        m_nrIdle.fetch_sub(1);
+    }
+    std::unique_lock<std::mutex> lck(pParticipant->m_parkMtx);
+    pParticipant->m_wakeup = true;
+    pParticipant->m_parkCv.notify_one();
+}
+
+void WorkStealingCoroutineScheduler::leaveIdle(Participant& self) {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    if(self.m_isIdle) {
+        m_idle.erase(std::find(m_idle.begin(), m_idle.end(), &self));
+        self.m_isIdle = false;
+        m_nrIdle.fetch_sub(1);
+    }
+}
+
+bool WorkStealingCoroutineScheduler::hasVisibleTasks() const {
+    if(m_nrInjected.load() > 0) return true;
+    unsigned nrStealable = m_nrStealable.load(std::memory_order_acquire);
+    for(unsigned i=0 ; i<nrStealable ; ++i) {
+        if(!m_stealable[i].load(std::memory_order_acquire)->m_tasks.empty()) return true;
+    }
+    return false;
+}
+
+void* WorkStealingCoroutineScheduler::findTask(Participant& self) {
+    if(self.m_isStealable) {
+        if(void* pTask = self.m_tasks.pop()) {
+            return pTask;
+        }
+    }
+
+    if(m_nrInjected.load(std::memory_order_relaxed) > 0) {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        if(!m_injected.empty()) {
+            void* pTask = m_injected.front();
+            m_injected.pop_front();
+            m_nrInjected.fetch_sub(1);
+            return pTask;
+        }
+    }
+
+    unsigned nrStealable = m_nrStealable.load(std::memory_order_acquire);
+    if(nrStealable == 0) return nullptr;
+    unsigned start = self.nextRandom() % nrStealable;
+    for(unsigned i=0 ; i<nrStealable ; ++i) {
+        Participant* pVictim = m_stealable[(start + i) % nrStealable].load(std::memory_order_acquire);
+        if(pVictim == &self) continue;
+        if(void* pTask = pVictim->m_tasks.steal()) {
+            return pTask;
+        }
+    }
+    return nullptr;
+}
+
+std::coroutine_handle<void> WorkStealingCoroutineScheduler::schedule() {
+    Participant& self = currentParticipant();
+    while(true) {
+        if(self.m_isThreadRunnable.exchange(false)) {
+            // we may have been woken up for a coroutine as well; pass that on
+            if(hasVisibleTasks()) {
+                wakeOne();
+            }
+            return nullptr;
+        }
+        if(void* pTask = findTask(self)) {
+            return std::coroutine_handle<void>::from_address(pTask);
+        }
+
+        {
+            std::unique_lock<std::mutex> lck(m_mtx);
+            m_idle.push_back(&self);
+            self.m_isIdle = true;
+            m_nrIdle.fetch_add(1);
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(self.m_isThreadRunnable.load() || hasVisibleTasks()) {
+            leaveIdle(self);
+            continue;
+        }
+        {
+            std::unique_lock<std::mutex> lck(self.m_parkMtx);
+            self.m_parkCv.wait(lck, [&self]() { return self.m_wakeup || self.m_isThreadRunnable.load(); });
+            self.m_wakeup = false;
+        }
+        leaveIdle(self);
+    }
+}
+
+} // namespace carpal
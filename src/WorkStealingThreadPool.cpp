@@ -0,0 +1,189 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/WorkStealingThreadPool.h"
+#include "carpal/WorkStealingDeque.h"
+
+#include <assert.h>
+
+namespace carpal {
+
+namespace {
+
+constexpr size_t maxRecycledBoxes = 1024;
+
+thread_local WorkStealingThreadPool const* currentPool = nullptr;
+thread_local unsigned currentWorkerIndex = 0;
+
+} // namespace
+
+class WorkStealingThreadPool::Worker {
+public:
+    explicit Worker(unsigned index)
+        :m_rand(index * 2654435761u + 1)
+    {}
+
+    /** @brief Returns a pseudo-random number, used for choosing the steal victim (xorshift)*/
+    unsigned nextRandom() noexcept {
+        m_rand ^= m_rand << 13;
+        m_rand ^= m_rand >> 17;
+        m_rand ^= m_rand << 5;
+        return m_rand;
+    }
+
+    /** @brief Returns a box holding the given task, reusing a previously released one if available. Owner thread only.*/
+    Runnable* makeBox(Runnable task) {
+        if(m_freeBoxes.empty()) {
+            return new Runnable(std::move(task));
+        }
+        Runnable* pBox = m_freeBoxes.back();
+        m_freeBoxes.pop_back();
+        *pBox = std::move(task);
+        return pBox;
+    }
+
+    /** @brief Moves the task out of the box and keeps the box for reuse. Owner thread only.*/
+    Runnable unbox(Runnable* pBox) {
+        Runnable ret = std::move(*pBox);
+        if(m_freeBoxes.size() < maxRecycledBoxes) {
+            m_freeBoxes.push_back(pBox);
+        } else {
+            delete pBox;
+        }
+        return ret;
+    }
+
+    ~Worker() {
+        while(Runnable* pBox = m_tasks.pop()) {
+            delete pBox;
+        }
+        for(Runnable* pBox : m_freeBoxes) {
+            delete pBox;
+        }
+    }
+
+    WorkStealingDeque<Runnable*> m_tasks;
+private:
+    std::vector<Runnable*> m_freeBoxes;
+    unsigned m_rand;
+};
+
+WorkStealingThreadPool::WorkStealingThreadPool(unsigned nrThreads) {
+    if(nrThreads == 0) nrThreads = 1;
+    m_workers.reserve(nrThreads);
+    for(unsigned i=0 ; i<nrThreads ; ++i) {
+        m_workers.push_back(std::make_unique<Worker>(i));
+    }
+    m_threads.reserve(nrThreads);
+    for(unsigned i=0 ; i<nrThreads ; ++i) {
+        m_threads.emplace_back(&WorkStealingThreadPool::threadFunction, this, i);
+    }
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool() {
+    close();
+    for(std::thread& t : m_threads) {
+        t.join();
+    }
+}
+
+void WorkStealingThreadPool::enqueue(Runnable func) {
+    if(currentPool == this) {
+        Worker& worker = *m_workers[currentWorkerIndex];
+        worker.m_tasks.push(worker.makeBox(std::move(func)));
+    } else {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        m_injectedTasks.push_back(std::move(func));
+        m_nrInjectedTasks.fetch_add(1);
+    }
+    wakeOne();
+}
+
+void WorkStealingThreadPool::close() {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    m_isClosed = true;
+    m_cv.notify_all();
+}
+
+void WorkStealingThreadPool::wakeOne() {
+    // pairs with the fence in threadFunction(): either we see the sleeper, or the sleeper sees the new task
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_nrSleepingThreads.load(std::memory_order_relaxed) > 0) {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        m_cv.notify_one();
+    }
+}
+
+bool WorkStealingThreadPool::hasVisibleTasks() const {
+    if(m_nrInjectedTasks.load() > 0) return true;
+    for(auto const& pWorker : m_workers) {
+        if(!pWorker->m_tasks.empty()) return true;
+    }
+    return false;
+}
+
+bool WorkStealingThreadPool::findTask(unsigned index, Runnable& task) {
+    Worker& self = *m_workers[index];
+    Runnable* pBox = self.m_tasks.pop();
+    if(pBox != nullptr) {
+        task = self.unbox(pBox);
+        return true;
+    }
+
+    if(m_nrInjectedTasks.load(std::memory_order_relaxed) > 0) {
+        std::unique_lock<std::mutex> lck(m_mtx);
+        if(!m_injectedTasks.empty()) {
+            task = std::move(m_injectedTasks.front());
+            m_injectedTasks.pop_front();
+            m_nrInjectedTasks.fetch_sub(1);
+            return true;
+        }
+    }
+
+    unsigned nrWorkers = static_cast<unsigned>(m_workers.size());
+    unsigned start = self.nextRandom() % nrWorkers;
+    for(unsigned i=0 ; i<nrWorkers ; ++i) {
+        unsigned victim = (start + i) % nrWorkers;
+        if(victim == index) continue;
+        pBox = m_workers[victim]->m_tasks.steal();
+        if(pBox != nullptr) {
+            // the box migrates to the thief's free list
+            task = self.unbox(pBox);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingThreadPool::threadFunction(unsigned index) {
+    currentPool = this;
+    currentWorkerIndex = index;
+    Runnable task;
+    while(true) {
+        if(findTask(index, task)) {
+            try {
+                task();
+            } catch (...) {
+                assert(false);
+            }
+            task.reset();
+            continue;
+        }
+        std::unique_lock<std::mutex> lck(m_mtx);
+        m_nrSleepingThreads.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(hasVisibleTasks()) {
+            m_nrSleepingThreads.fetch_sub(1);
+            continue;
+        }
+        if(m_isClosed) {
+            m_nrSleepingThreads.fetch_sub(1);
+            return;
+        }
+        m_cv.wait(lck);
+        m_nrSleepingThreads.fetch_sub(1);
+    }
+}
+
+} // namespace carpal
@@ -6,18 +6,91 @@
 
 #include "carpal/CoroutineScheduler.h"
 #include "carpal/Future.h"
+#include "carpal/MemoryResource.h"
 
+#include <atomic>
 #include <coroutine>
-#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <thread>
 
 #include <assert.h>
+#include <string.h>
 
 namespace carpal {
 
     template<typename T>
+    class Task;
+
+namespace carpal_private {
+
+    /** @brief Base of the promise types, allocating the coroutine frames from a memory resource instead of the global
+     * allocator.
+     *
+     * The resource is the one given after a leading @c std::allocator_arg argument of the coroutine if any, otherwise
+     * @c currentMemoryResource() if set, otherwise @c threadLocalPoolResource(). It is stored at the end of the frame, so that
+     * the frame can be freed on any thread.*/
+    class CoroutineFrameAllocator {
+    public:
+        static void* operator new(std::size_t size) {
+            std::pmr::memory_resource* pResource = currentMemoryResource();
+            return allocate(size, pResource != nullptr ? pResource : threadLocalPoolResource());
+        }
+
+        /** @brief Allocates the frame of a coroutine taking @c std::allocator_arg and a memory resource as its first arguments.
+         *
+         * @note In unoptimized builds, GCC 12 reports such coroutines with a false @c -Wmismatched-new-delete warning: the
+         * frame is always freed via the usual sized @c operator @c delete below, which GCC does not pair with an @c operator
+         * @c new that is a function template, although it does handle frames from either. Since the warning points into the
+         * coroutine, not into this header, silence it around the coroutine definition:
+         * @code
+         * #pragma GCC diagnostic push
+         * #pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+         * AsyncCoroutine<int> f(std::allocator_arg_t, std::pmr::memory_resource*, CoroutineScheduler*) {
+         *     co_return 0;
+         * }
+         * #pragma GCC diagnostic pop
+         * @endcode
+         * or build with @c -Wno-mismatched-new-delete.*/
+        template<typename... Args>
+        static void* operator new(std::size_t size, std::allocator_arg_t, std::pmr::memory_resource* pResource, Args const&...) {
+            return allocate(size, pResource);
+        }
+
+        static void operator delete(void* p, std::size_t size) noexcept {
+            std::pmr::memory_resource* pResource;
+            memcpy(&pResource, static_cast<char*>(p) + resourceOffset(size), sizeof(pResource));
+            pResource->deallocate(p, resourceOffset(size) + sizeof(pResource), __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+        }
+
+        /** @brief Matches the placement @c operator @c new above; the resource is taken from the frame, as for the other one.*/
+        template<typename... Args>
+        static void operator delete(void* p, std::size_t size, std::allocator_arg_t, std::pmr::memory_resource*, Args const&...) noexcept {
+            operator delete(p, size);
+        }
+
+    private:
+        static std::size_t resourceOffset(std::size_t size) noexcept {
+            constexpr std::size_t alignment = alignof(std::pmr::memory_resource*);
+            return (size + alignment - 1) / alignment * alignment;
+        }
+
+        static void* allocate(std::size_t size, std::pmr::memory_resource* pResource) {
+            void* p = pResource->allocate(resourceOffset(size) + sizeof(pResource), __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+            memcpy(static_cast<char*>(p) + resourceOffset(size), &pResource, sizeof(pResource));
+            return p;
+        }
+    };
+
+} // namespace carpal_private
+
+    /** @brief Awaits a future; the awaiting coroutine is then resumed via the given scheduler or, if @c nullptr, on the
+     * thread completing the future.*/
+    template<typename T>
     class FutureAwaiter {
     public:
-        FutureAwaiter(CoroutineScheduler* pScheduler, Future<T> future)
+        FutureAwaiter(AbstractCoroutineScheduler* pScheduler, Future<T> future)
             :m_pScheduler(pScheduler),
             m_pFuture(future.getPromiseFuturePair())
         {
@@ -28,17 +101,21 @@ namespace carpal {
             return m_pFuture->isComplete();
         }
         void await_suspend(std::coroutine_handle<void> thisHandler) {
-            CoroutineScheduler* pScheduler = m_pScheduler;
+            AbstractCoroutineScheduler* pScheduler = m_pScheduler;
             m_pFuture->addSynchronousCallback([pScheduler, thisHandler]() {
-                pScheduler->markRunnable(thisHandler);
+                if(pScheduler != nullptr) {
+                    pScheduler->markRunnable(thisHandler);
+                } else {
+                    thisHandler.resume();
+                }
             });
         }
         T await_resume() {
             return m_pFuture->get();
         }
     private:
-        CoroutineScheduler* m_pScheduler;
-        std::shared_ptr<PromiseFuturePair<T> > m_pFuture;
+        AbstractCoroutineScheduler* m_pScheduler;
+        RefPtr<PromiseFuturePair<T> > m_pFuture;
     };
 
 
@@ -49,6 +126,8 @@ namespace carpal {
      * The caller gets control back at the latest when the coroutine ends.
      * The caller can get the result by calling get(), which blocks until the coroutine ends. get() returns the coroutine return value.
      * While the result is not available, get() tries to schedule some available coroutine to the current thread.
+     * The @c AsyncCoroutine object may be destroyed before the coroutine ends; the coroutine then keeps running, and is
+     * destroyed when it ends.
      * 
      * */
     template<typename T>
@@ -73,9 +152,12 @@ namespace carpal {
         AsyncCoroutine& operator=(AsyncCoroutine&& src) {
             AsyncCoroutine<T> tmp(std::move(src));
             std::swap(m_handle, tmp.m_handle);
+            return *this;
         }
+        /** @brief Destroys the coroutine if finished; otherwise, leaves it running (fire-and-forget), and it destroys
+         * itself when it finishes.*/
         ~AsyncCoroutine() {
-            if (m_handle != nullptr) {
+            if (m_handle != nullptr && m_handle.promise().detach()) {
                 m_handle.destroy();
             }
         }
@@ -90,19 +172,34 @@ namespace carpal {
     template<typename T>
     class AsyncCoroutine<T>::Awaiter {
     public:
-        Awaiter(AsyncCoroutine<T>& asyncGenerator, CoroutineScheduler* pConsumerScheduler);
+        Awaiter(AsyncCoroutine<T>& asyncGenerator, AbstractCoroutineScheduler* pConsumerScheduler);
         bool await_ready() const;
-        void await_suspend(std::coroutine_handle<void> consumerHandler);
+        bool await_suspend(std::coroutine_handle<void> consumerHandler);
         T& await_resume();
     private:
         std::coroutine_handle<AsyncCoroutine<T>::promise_type> m_handle;
         AsyncCoroutine<T>::promise_type* m_pPromise;
-        CoroutineScheduler* m_pConsumerScheduler;
+        AbstractCoroutineScheduler* m_pConsumerScheduler;
     };
 
     template<typename T>
-    class AsyncCoroutine<T>::promise_type {
+    class AsyncCoroutine<T>::promise_type : public carpal_private::CoroutineFrameAllocator {
     public:
+        /** @brief Signals the completion once the coroutine is suspended for the last time, so that the consumer,
+         * possibly running on another thread, can destroy the coroutine as soon as it sees the completion.*/
+        class FinalAwaiter {
+        public:
+            bool await_ready() const noexcept {
+                return false;
+            }
+            void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                if(handle.promise().onFinished()) {
+                    handle.destroy();
+                }
+            }
+            void await_resume() const noexcept {}
+        };
+
         promise_type()
             :m_pScheduler(defaultCoroutineScheduler())
         {
@@ -110,7 +207,15 @@ namespace carpal {
         }
 
         template<typename... Args>
-        explicit promise_type(CoroutineScheduler* pScheduler, Args const&...)
+        explicit promise_type(AbstractCoroutineScheduler* pScheduler, Args const&...)
+            :m_pScheduler(pScheduler)
+        {
+            // nothing else
+        }
+
+        /** @brief Used for coroutines taking a memory resource for their frame (see @c CoroutineFrameAllocator).*/
+        template<typename... Args>
+        promise_type(std::allocator_arg_t, std::pmr::memory_resource*, AbstractCoroutineScheduler* pScheduler, Args const&...)
             :m_pScheduler(pScheduler)
         {
             // nothing else
@@ -119,8 +224,8 @@ namespace carpal {
         std::suspend_never initial_suspend() {
             return std::suspend_never();
         }
-        std::suspend_always final_suspend() noexcept {
-            return std::suspend_always();
+        FinalAwaiter final_suspend() noexcept {
+            return FinalAwaiter();
         }
         void unhandled_exception() {
             assert(false);
@@ -132,55 +237,87 @@ namespace carpal {
         }
 
         void return_value(T val) {
-            std::unique_lock<std::mutex> lck(m_mutex);
             m_val = std::move(val);
-            std::function<void()> callback = std::move(m_callback);
-            m_callback = nullptr;
-            lck.unlock();
-            if(callback != nullptr) {
-                callback();
-            }
+        }
+
+        /** @brief Returns true if the coroutine has finished and is suspended at its final suspend point*/
+        bool isDone() const {
+            return (m_state.load(std::memory_order_acquire) & isDoneFlag) != 0;
         }
 
         template<typename R>
         FutureAwaiter<R> await_transform(Future<R> future) {
-            return FutureAwaiter<T>(m_pScheduler, future);
+            return FutureAwaiter<R>(m_pScheduler, future);
         }
 
         template<typename R>
-        AsyncCoroutine<R>::Awaiter await_transform(AsyncCoroutine<R>& asyncGenerator) {
+        typename AsyncCoroutine<R>::Awaiter await_transform(AsyncCoroutine<R>& asyncGenerator) {
             return typename AsyncCoroutine<R>::Awaiter(asyncGenerator, m_pScheduler);
         }
 
-        void addSynchronousCallback(std::function<void()> callback) {
-            std::unique_lock<std::mutex> lck(m_mutex);
-            if(m_val.has_value()) {
-                lck.unlock();
-                callback();
-                return;
-            }
-            if(m_callback == nullptr) {
-                m_callback = std::move(callback);
-            } else {
-                m_callback = [first=std::move(m_callback),second=std::move(callback)](){
-                    first();
-                    second();
-                };
-            }
-        }
+        /** @brief Starts the task on the current thread; defined in Task.h.*/
+        template<typename R>
+        typename Task<R>::Awaiter await_transform(Task<R>&& task);
+
+        template<typename R>
+        typename Task<R>::Awaiter await_transform(Task<R>& task);
 
     private:
         friend class AsyncCoroutine<T>;
         friend class AsyncCoroutine<T>::Awaiter;
 
-        CoroutineScheduler* m_pScheduler;
-        std::mutex m_mutex;
+        /** @brief Sets the coroutine, if @c consumerHandler is not null, or the thread, otherwise, to be marked runnable on the
+         * given scheduler when the coroutine finishes. Returns false, without setting anything, if the coroutine has already
+         * finished. At most one waiter may be set.*/
+        bool setWaiter(AbstractCoroutineScheduler* pScheduler, std::coroutine_handle<void> consumerHandler, std::thread::id tid) {
+            m_pWaiterScheduler = pScheduler;
+            m_waiterHandler = consumerHandler;
+            m_waiterThread = tid;
+            unsigned prev = m_state.fetch_or(hasWaiterFlag, std::memory_order_acq_rel);
+            assert((prev & hasWaiterFlag) == 0);
+            return (prev & isDoneFlag) == 0;
+        }
+
+        /** @brief Marks the coroutine as finished and wakes up the waiter, if any. Returns true if the coroutine was detached,
+         * and so must destroy itself.*/
+        bool onFinished() {
+            unsigned prev = m_state.fetch_or(isDoneFlag, std::memory_order_acq_rel);
+            if((prev & hasWaiterFlag) != 0) {
+                // Copied first, as the waiter may destroy the coroutine as soon as it is woken up
+                AbstractCoroutineScheduler* pScheduler = m_pWaiterScheduler;
+                std::coroutine_handle<void> waiterHandler = m_waiterHandler;
+                std::thread::id waiterThread = m_waiterThread;
+                bool isDetached = (prev & isDetachedFlag) != 0;
+                if(waiterHandler != nullptr) {
+                    pScheduler->markRunnable(waiterHandler);
+                } else {
+                    pScheduler->markThreadRunnable(waiterThread);
+                }
+                return isDetached;
+            }
+            return (prev & isDetachedFlag) != 0;
+        }
+
+        /** @brief Called when the @c AsyncCoroutine object is destroyed. Returns true if the coroutine is finished, and so the
+         * caller must destroy it; otherwise, the coroutine destroys itself when it finishes.*/
+        bool detach() {
+            return (m_state.fetch_or(isDetachedFlag, std::memory_order_acq_rel) & isDoneFlag) != 0;
+        }
+
+        static constexpr unsigned isDoneFlag = 1;
+        static constexpr unsigned isDetachedFlag = 2;
+        static constexpr unsigned hasWaiterFlag = 4;
+
+        AbstractCoroutineScheduler* m_pScheduler;
+        std::atomic<unsigned> m_state{0};
         std::optional<T> m_val;
-        std::function<void()> m_callback = nullptr;
+        AbstractCoroutineScheduler* m_pWaiterScheduler = nullptr;
+        std::coroutine_handle<void> m_waiterHandler = nullptr;
+        std::thread::id m_waiterThread;
     };
 
     template<typename T>
-    AsyncCoroutine<T>::Awaiter::Awaiter(AsyncCoroutine<T>& asyncGenerator, CoroutineScheduler* pConsumerScheduler)
+    AsyncCoroutine<T>::Awaiter::Awaiter(AsyncCoroutine<T>& asyncGenerator, AbstractCoroutineScheduler* pConsumerScheduler)
         :m_handle(asyncGenerator.m_handle),
         m_pPromise(&(asyncGenerator.m_handle.promise())),
         m_pConsumerScheduler(pConsumerScheduler)
@@ -189,13 +326,13 @@ namespace carpal {
 
     template<typename T>
     bool AsyncCoroutine<T>::Awaiter::await_ready() const {
-        return m_pPromise->m_val.has_value();
+        return m_pPromise->isDone();
     }
 
     template<typename T>
-    void AsyncCoroutine<T>::Awaiter::await_suspend(std::coroutine_handle<void> consumerHandler)
+    bool AsyncCoroutine<T>::Awaiter::await_suspend(std::coroutine_handle<void> consumerHandler)
     {
-        m_pPromise->setHandleToResume(consumerHandler);
+        return m_pPromise->setWaiter(m_pConsumerScheduler, consumerHandler, std::thread::id());
     }
 
     template<typename T>
@@ -206,20 +343,17 @@ namespace carpal {
     template<typename T>
     T& AsyncCoroutine<T>::get() {
         AsyncCoroutine<T>::promise_type& promise(m_handle.promise());
-        {
-            std::unique_lock<std::mutex> lck(promise.m_mutex);
-            if(promise.m_val.has_value()) {
-                return promise.m_val.value();
-            }
+        if(promise.isDone()) {
+            return promise.m_val.value();
+        }
+        if(!promise.setWaiter(promise.m_pScheduler, nullptr, std::this_thread::get_id())) {
+            return promise.m_val.value();
         }
-        promise.addSynchronousCallback([tid=std::this_thread::get_id(),pScheduler=promise.m_pScheduler](){
-            pScheduler->markThreadRunnable(tid);
-        });
         while(true) {
             auto coroHandle = promise.m_pScheduler->schedule();
             if(coroHandle != nullptr) {
                 coroHandle.resume();
-            } else if(promise.m_val.has_value()) {
+            } else if(promise.isDone()) {
                 return promise.m_val.value();
             } else {
                 assert(false);
@@ -0,0 +1,179 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include "RefCounted.h"
+#include "Runnable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace carpal {
+
+/** @brief Set into the future of a computation skipped because its cancellation token was canceled*/
+class OperationCanceledException : public std::runtime_error {
+public:
+    OperationCanceledException()
+        :std::runtime_error("operation canceled")
+    {}
+};
+
+namespace carpal_private {
+
+/** @brief [Internal use] The state shared by a @c CancellationSource, its tokens, and the futures created under them*/
+class CancellationState : public RefCounted {
+    struct Callback {
+        std::uint64_t id;
+        Runnable func;
+    };
+
+public:
+    /** @brief Identifies a registered callback*/
+    class CallbackHandle {
+    private:
+        friend CancellationState;
+        std::list<Callback>::iterator m_it;
+        std::uint64_t m_id = 0;
+    };
+
+    bool isCanceled() const noexcept {
+        return m_isCanceled.load(std::memory_order_acquire);
+    }
+
+    /** @brief Marks the state as canceled and executes, on the current thread, the registered callbacks, in the order they
+     * were registered. Only the first call has any effect.*/
+    void cancel();
+
+    /** @brief Registers a callback to be executed on cancellation. If already canceled, returns false without registering it.*/
+    bool addCallback(Runnable callback, CallbackHandle& handle);
+
+    /** @brief Unregisters a callback, so that it does not get executed. If the callback is being executed on another thread,
+     * waits for it to return, so that the caller may then destroy what the callback uses; if on the current thread (that is,
+     * from within the callback), returns immediately.*/
+    void removeCallback(CallbackHandle const& handle) noexcept;
+
+private:
+    std::atomic<bool> m_isCanceled{false};
+    std::mutex m_mtx;
+    std::condition_variable m_callbackDone;
+    /** @brief The callbacks not executed yet, in increasing order of their ids*/
+    std::list<Callback> m_callbacks;
+    std::uint64_t m_lastId = 0;
+    /** @brief The id of the last callback started by @c cancel(); the ones with smaller ids are done*/
+    std::uint64_t m_lastStartedId = 0;
+    bool m_isCallbackRunning = false;
+    std::thread::id m_cancelingThread;
+};
+
+/** @brief [Internal use] Returns the cancellation state set for the current thread, or @c nullptr.*/
+CancellationState* currentCancellationState() noexcept;
+
+/** @brief [Internal use] Sets the cancellation state for the current thread and returns the previous one.*/
+CancellationState* setCurrentCancellationState(CancellationState* pState) noexcept;
+
+/** @brief [Internal use] Sets the cancellation state for the current thread for the lifetime of the object. Used while
+ * executing a continuation, so that the futures it creates inherit its cancellation token.*/
+class CancellationStateScope {
+public:
+    explicit CancellationStateScope(CancellationState* pState) noexcept
+        :m_pPrevious(setCurrentCancellationState(pState))
+    {}
+    ~CancellationStateScope() {
+        setCurrentCancellationState(m_pPrevious);
+    }
+    CancellationStateScope(CancellationStateScope const&) = delete;
+    CancellationStateScope& operator=(CancellationStateScope const&) = delete;
+
+private:
+    CancellationState* m_pPrevious;
+};
+
+} // namespace carpal_private
+
+/** @brief Allows checking whether the cancellation of a group of computations was requested, via the @c CancellationSource
+ * that created the token. A default-constructed token is never canceled.*/
+class CancellationToken {
+public:
+    CancellationToken() noexcept = default;
+
+    bool isCancellationRequested() const noexcept {
+        return m_pState && m_pState->isCanceled();
+    }
+
+    /** @brief Returns false for a default-constructed token*/
+    bool canBeCanceled() const noexcept {
+        return bool(m_pState);
+    }
+
+private:
+    friend class CancellationSource;
+    friend class CancellationScope;
+    friend CancellationToken currentCancellationToken() noexcept;
+
+    explicit CancellationToken(RefPtr<carpal_private::CancellationState> pState) noexcept
+        :m_pState(std::move(pState))
+    {}
+
+    RefPtr<carpal_private::CancellationState> m_pState;
+};
+
+/** @brief Requests the cancellation of the computations created under its tokens (see @c CancellationScope).
+ *
+ * Copies of a source share the same state.*/
+class CancellationSource {
+public:
+    CancellationSource()
+        :m_pState(makeRefCounted<carpal_private::CancellationState>())
+    {}
+
+    CancellationToken token() const noexcept {
+        return CancellationToken(m_pState);
+    }
+
+    /** @brief Requests cancellation. The continuations not started yet complete with an @c OperationCanceledException
+     * instead of executing, and the pending timers are canceled, on the current thread.*/
+    void cancel() {
+        m_pState->cancel();
+    }
+
+    bool isCancellationRequested() const noexcept {
+        return m_pState->isCanceled();
+    }
+
+private:
+    RefPtr<carpal_private::CancellationState> m_pState;
+};
+
+/** @brief Returns the cancellation token set, for the current thread, by the innermost @c CancellationScope, or by the
+ * continuation being executed.*/
+CancellationToken currentCancellationToken() noexcept;
+
+/** @brief Sets the cancellation token for the current thread for the lifetime of the object, then restores the previous one.
+ *
+ * The futures created on the current thread (continuations, asynchronous tasks, timers) are bound to the token. When the token
+ * is canceled, a continuation that did not start executing completes with an @c OperationCanceledException, without being
+ * enqueued, and so does any continuation depending on it. A continuation that is already executing is not interrupted; it may
+ * check @c currentCancellationToken(). The continuations created while executing a continuation are bound to the same token,
+ * so the whole chain is canceled at once. A default-constructed token makes the futures created in the scope not cancelable.*/
+class CancellationScope {
+public:
+    explicit CancellationScope(CancellationToken token) noexcept
+        :m_token(std::move(token)),
+        m_scope(m_token.m_pState.get())
+    {}
+    CancellationScope(CancellationScope const&) = delete;
+    CancellationScope& operator=(CancellationScope const&) = delete;
+
+private:
+    CancellationToken m_token;
+    carpal_private::CancellationStateScope m_scope;
+};
+
+} // namespace carpal
@@ -13,25 +13,40 @@
 
 namespace carpal {
 
-/** @brief Scheduler for coroutines
+/** @brief Interface of the schedulers for coroutines
  * */
-class CoroutineScheduler {
+class AbstractCoroutineScheduler {
 public:
-    CoroutineScheduler();
-    ~CoroutineScheduler();
+    virtual ~AbstractCoroutineScheduler() {}
 
     /** @brief Marks the specified coroutine handler runnable. This means it will be returned, at some later time, by a @c schedule() call
      * */
-    void markRunnable(std::coroutine_handle<void> h);
+    virtual void markRunnable(std::coroutine_handle<void> h) = 0;
 
     /** @brief Marks the specified thread runnable. This means it will return, at some later time, by a @c schedule() call
      * */
-    void markThreadRunnable(std::thread::id tid);
+    virtual void markThreadRunnable(std::thread::id tid) = 0;
 
     /** @brief Returns a runnable coroutine (specified by a @c markRunnable() call), or @c nullptr if this thread is specified as runnable
      * by a @c markRunnable() call.
      * */
-    std::coroutine_handle<void> schedule();
+    virtual std::coroutine_handle<void> schedule() = 0;
+};
+
+/** @brief Scheduler for coroutines
+ *
+ * This implementation keeps all the runnable coroutines in a single queue; see @c WorkStealingCoroutineScheduler for one
+ * scaling to more threads, and @c ExecutorCoroutineScheduler for one resuming them on an executor. A coroutine that may be
+ * given any of them takes an @c AbstractCoroutineScheduler*.
+ * */
+class CoroutineScheduler : public AbstractCoroutineScheduler {
+public:
+    CoroutineScheduler();
+    ~CoroutineScheduler() override;
+
+    void markRunnable(std::coroutine_handle<void> h) override;
+    void markThreadRunnable(std::thread::id tid) override;
+    std::coroutine_handle<void> schedule() override;
 
 private:
     std::mutex m_mtx;
@@ -4,15 +4,34 @@
 
 #pragma once
 
-#include <functional>
+#include "Runnable.h"
+
+#include <stdexcept>
 
 namespace carpal {
 
+/** @brief Thrown by @c Executor::enqueue(), or set into the future of the computation, when an executor refuses a task
+ * (for instance, a bounded @c ThreadPool whose queue is full).*/
+class ExecutorRejectedException : public std::runtime_error {
+public:
+    ExecutorRejectedException()
+        :std::runtime_error("task rejected by executor")
+    {}
+};
+
 class Executor {
 public:
     virtual ~Executor() {}
     
-    virtual void enqueue(std::function<void()> func) = 0;
+    virtual void enqueue(Runnable func) = 0;
+
+    /** @brief Enqueues the task, unless the executor refuses it. In that case, returns false and leaves @c func unchanged.
+     *
+     * The default implementation calls @c enqueue() and returns true.*/
+    virtual bool tryEnqueue(Runnable& func) {
+        enqueue(std::move(func));
+        return true;
+    }
 };
 
 } // namespace carpal
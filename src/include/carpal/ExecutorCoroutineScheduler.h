@@ -0,0 +1,43 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "CoroutineScheduler.h"
+#include "Executor.h"
+
+namespace carpal {
+
+/** @brief A coroutine scheduler that resumes the runnable coroutines on an executor.
+ *
+ * Coroutines make progress on the executor threads, whether or not some thread waits for them, so they can be started and
+ * left running (fire-and-forget). A thread calling @c schedule() (typically, from @c AsyncCoroutine::get()) only waits to be
+ * marked runnable; it never gets a coroutine to run. If the executor refuses a coroutine (see @c Executor::tryEnqueue()), the
+ * coroutine is resumed on the thread marking it runnable.
+ * */
+class ExecutorCoroutineScheduler : public AbstractCoroutineScheduler {
+public:
+    explicit ExecutorCoroutineScheduler(Executor* pExecutor);
+    ~ExecutorCoroutineScheduler() override;
+
+    void markRunnable(std::coroutine_handle<void> h) override;
+    void markThreadRunnable(std::thread::id tid) override;
+    std::coroutine_handle<void> schedule() override;
+
+private:
+    Executor* m_pExecutor;
+    std::mutex m_mtx;
+    std::unordered_set<std::thread::id> m_runnableThreads;
+    /** @brief The threads waiting in @c schedule(), each on its own condition variable*/
+    std::unordered_map<std::thread::id, std::condition_variable*> m_waitingThreads;
+};
+
+} // namespace carpal
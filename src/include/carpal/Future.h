@@ -10,25 +10,54 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <cstdint>
 #include <list>
+#include <stdexcept>
 #include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "Cancellation.h"
 #include "Executor.h"
+#include "RefCounted.h"
 
 namespace carpal {
 
 Executor* defaultExecutor();
 
+/** @brief Returns an @c InlineExecutor, falling back to @c defaultExecutor(), used by the @c thenInline() functions.*/
+Executor* inlineExecutor();
+
 template<typename T>
 class Future;
 
+/** @brief A callback to be executed when a @see PromiseFuturePairBase completes.
+ *
+ * The nodes are linked intrusively into the list of continuations of the @c PromiseFuturePairBase, so registering a node
+ * needs no other allocation. After @c execute() or @c discard() is called, the future does not access the node anymore;
+ * it is up to the node to release its own resources.
+*/
+class CallbackNode {
+public:
+    virtual ~CallbackNode() {}
+
+    /** @brief Called once, when the future completes (or immediately, if it is already complete). Must not throw.*/
+    virtual void execute() noexcept = 0;
+
+    /** @brief Called instead of @c execute() if the future is destroyed without ever completing.*/
+    virtual void discard() noexcept = 0;
+
+private:
+    friend class PromiseFuturePairBase;
+    CallbackNode* m_pNextCallback = nullptr;
+};
+
 /** @brief Base class for @see PromiseFuturePair, that signals the completion of an asynchronous process.
 */
-class PromiseFuturePairBase {
+class PromiseFuturePairBase : public RefCounted {
 public:
-    using CallbackType = std::function<void()>;
+    using CallbackType = Runnable;
 
     /** @brief The possible current state of an asynchronous computation
      * */
@@ -38,31 +67,45 @@ public:
         exception ///< @brief Completed with an exception
     };
 
+    /** @brief Binds the computation to the cancellation token current on the creating thread, if any (see @c CancellationScope).*/
+    PromiseFuturePairBase() noexcept
+        :m_pCancellationState(carpal_private::currentCancellationState())
+    {}
+
     virtual ~PromiseFuturePairBase();
 
+    /** @brief Returns true if the cancellation token the computation is bound to was canceled.*/
+    bool isCancellationRequested() const noexcept {
+        return m_pCancellationState && m_pCancellationState->isCanceled();
+    }
+
+    /** @brief [Internal use] Returns the state of the cancellation token the computation is bound to, or @c nullptr.*/
+    carpal_private::CancellationState* cancellationState() const noexcept {
+        return m_pCancellationState.get();
+    }
+
     /** @brief Waits (blocking the current thread) until the asynchronous computation completes.*/
     void wait() const noexcept {
-        if(m_state != State::not_completed) return;
-        std::unique_lock<std::mutex> lck(m_mtx);
-        while(m_state == State::not_completed) m_cv.wait(lck);
+        if(state() != State::not_completed) return;
+        waitForCompletion();
     }
 
     /** @brief Returns true if already completed. Does not wait.
      * @note a false result can be outdated by the time the caller can use the result.*/
     bool isComplete() const noexcept {
-        return m_state != State::not_completed;
+        return state() != State::not_completed;
     }
 
     /** @brief Returns true if the asynchronous computation completed normally (without throwing an exception). Does not wait.
      * @note a false result can be outdated by the time the caller can use the result.*/
     bool isCompletedNormally() const noexcept {
-        return m_state == State::completed_normally;
+        return state() == State::completed_normally;
     }
 
     /** @brief Returns true if the asynchronous computation completed by throwing an exception. Does not wait.
      * @note a false result can be outdated by the time the caller can use the result.*/
     bool isException() const noexcept {
-        return m_state == State::exception;
+        return state() == State::exception;
     }
 
     /** @brief Waits until the asynchronous computation completes (if not completed yet), then returns the exception (if
@@ -78,21 +121,50 @@ public:
     * function returns. If the event is not triggered yet, then the callback will be called on the thread
     * calling @see notify().
     *
+    * Callbacks are executed in the order they were added. They must not throw.
+    *
     * @note The caller must make sure that the function remains valid (no dangling pointers) until it gets
     * executed.
     */
     void addSynchronousCallback(CallbackType callback);
 
+    /** @brief Same as @c addSynchronousCallback(), but taking a callback node owned by the caller. Does not allocate memory.*/
+    void addCallbackNode(CallbackNode* pNode) noexcept;
+
 protected:
     /** @brief Marks the computation complete. Must be called exactly once.*/
     void notify(State state);
 
+private:
+    /** @brief Blocks until the computation completes. Uses @c std::atomic::wait() where available, so that a future
+     * carries no mutex or condition variable of its own.*/
+    void waitForCompletion() const noexcept;
+
+    /** @brief Value of @c m_continuations once completed with the given state*/
+    static CallbackNode* completedMarker(State state) noexcept {
+        return reinterpret_cast<CallbackNode*>(std::uintptr_t(state));
+    }
+
+    /** @brief Returns true if the given value of @c m_continuations marks a completed computation*/
+    static bool isCompletedMarker(CallbackNode* pNode) noexcept {
+        return reinterpret_cast<std::uintptr_t>(pNode) <= std::uintptr_t(State::exception)
+            && pNode != nullptr;
+    }
+
 protected:
-    mutable std::mutex m_mtx;
-    mutable std::condition_variable m_cv;
-    std::atomic<State> m_state{State::not_completed};
+    /** @brief Returns the current state. Does not wait.*/
+    State state() const noexcept {
+        CallbackNode* pNode = m_continuations.load(std::memory_order_acquire);
+        return isCompletedMarker(pNode) ? State(reinterpret_cast<std::uintptr_t>(pNode)) : State::not_completed;
+    }
+
     std::exception_ptr m_exception = nullptr;
-    CallbackType m_continuations = nullptr;
+private:
+    RefPtr<carpal_private::CancellationState> m_pCancellationState;
+    /** @brief Lock-free stack of the callbacks to execute on completion (last added first), or, once completed, the
+     * final state encoded by @c completedMarker(). Publishing the state and taking the callbacks is a single atomic
+     * exchange, so that @c notify() does not touch the object after a waiter may have been released.*/
+    std::atomic<CallbackNode*> m_continuations{nullptr};
 };
 
 /** @brief A channel by which a consumer can get a value that will be produced by a producer at some
@@ -113,7 +185,7 @@ public:
      * to make sure this is not used with multiple consumers. */
     T& get() {
         this->wait();
-        if(m_state == State::completed_normally) {
+        if(state() == State::completed_normally) {
             return m_val.value();
         } else {
             std::rethrow_exception(m_exception);
@@ -135,6 +207,11 @@ public:
      */
     template<typename Func, typename... Args>
     void computeAndSet(Func&& func, Args&&... args) noexcept {
+        if(this->isCancellationRequested()) {
+            this->setException(std::make_exception_ptr(OperationCanceledException()));
+            return;
+        }
+        carpal_private::CancellationStateScope scope(this->cancellationState());
         try {
             this->set(std::forward<Func>(func)(std::forward<Args>(args)...));
         } catch(...) {
@@ -146,7 +223,7 @@ public:
      * 
      * @note This function is provided to simplify generic code that also works with @c PromiseFuturePair<void>
      * */
-    void setFromOtherFutureMove(std::shared_ptr<PromiseFuturePair<T> > pF) {
+    void setFromOtherFutureMove(RefPtr<PromiseFuturePair<T> > pF) {
         if(pF->isCompletedNormally()) {
             this->set(std::move(pF->get()));
         } else {
@@ -162,6 +239,11 @@ public:
      */
     template<typename Func, typename... Args>
     void computeAndSetWithTuple(Func func, std::tuple<Args...> args) noexcept {
+        if(this->isCancellationRequested()) {
+            this->setException(std::make_exception_ptr(OperationCanceledException()));
+            return;
+        }
+        carpal_private::CancellationStateScope scope(this->cancellationState());
         try {
             this->set(std::apply(std::move(func), std::move(args)));
         } catch(...) {
@@ -191,7 +273,7 @@ public:
     /** @brief Waits (blocking the current thread) until the future completes.*/
     void get() {
         this->wait();
-        if(m_state == State::exception) {
+        if(state() == State::exception) {
             std::rethrow_exception(m_exception);
         }
     }
@@ -208,6 +290,11 @@ public:
      * */
     template<typename Func, typename... Args>
     void computeAndSet(Func&& func, Args&&... args) noexcept {
+        if(this->isCancellationRequested()) {
+            this->setException(std::make_exception_ptr(OperationCanceledException()));
+            return;
+        }
+        carpal_private::CancellationStateScope scope(this->cancellationState());
         try {
             std::forward<Func>(func)(std::forward<Args>(args)...);
             this->notify(State::completed_normally);
@@ -221,7 +308,7 @@ public:
      * 
      * @note This function is provided to simplify writing generic code.
      * */
-    void setFromOtherFutureMove(std::shared_ptr<PromiseFuturePairBase> pF) {
+    void setFromOtherFutureMove(RefPtr<PromiseFuturePairBase> pF) {
         if(pF->isCompletedNormally()) {
             this->notify(State::completed_normally);
         } else {
@@ -237,6 +324,11 @@ public:
      */
     template<typename Func, typename... Args>
     void computeAndSetWithTuple(Func func, std::tuple<Args...> args) noexcept {
+        if(this->isCancellationRequested()) {
+            this->setException(std::make_exception_ptr(OperationCanceledException()));
+            return;
+        }
+        carpal_private::CancellationStateScope scope(this->cancellationState());
         std::apply(std::move(func), std::move(args));
         this->notify(State::completed_normally);
     }
@@ -252,6 +344,43 @@ public:
 
 namespace carpal_private {
 
+/** @brief [Internal use] Enqueues the task on the executor; if the executor rejects it, completes the given future with
+ * an @c ExecutorRejectedException instead. If the cancellation of the future was requested, completes it with an
+ * @c OperationCanceledException, without enqueuing the task. The task is expected to hold a reference to the future.
+ * @note When the task captures the caller's reference by move, the caller must take the raw pointers beforehand, since the
+ * order of evaluation of the arguments is unspecified.*/
+template<typename F>
+void enqueueOrFail(Executor* pExecutor, F* pFuture, Runnable task) noexcept {
+    if(pFuture->isCancellationRequested()) {
+        pFuture->setException(std::make_exception_ptr(OperationCanceledException()));
+    } else if(!pExecutor->tryEnqueue(task)) {
+        pFuture->setException(std::make_exception_ptr(ExecutorRejectedException()));
+    }
+}
+
+/** @brief [Internal use] A continuation task that registers itself, as a callback node, on the future it depends on.
+ *
+ * While registered, the list of continuations of that future holds a reference to the task; on completion, that reference
+ * is passed to @c Derived::onFutureCompleted(). No memory is allocated for the registration itself.
+ * */
+template<typename Derived>
+class ContinuationNode : public CallbackNode {
+public:
+    /** @brief Registers the task to be notified when the given future completes.*/
+    void attachTo(PromiseFuturePairBase& antecessor) {
+        static_cast<Derived*>(this)->addRef();
+        antecessor.addCallbackNode(this);
+    }
+
+    void execute() noexcept override {
+        Derived::onFutureCompleted(RefPtr<Derived>::adopt(static_cast<Derived*>(this)));
+    }
+
+    void discard() noexcept override {
+        static_cast<Derived*>(this)->release();
+    }
+};
+
 /** @brief [Internal use] A task that is ready to start executing (does not depend on other futures) */
 template<typename R, typename Func>
 class ReadyTask : public PromiseFuturePair<R> {
@@ -268,7 +397,8 @@ private:
 
 /** @brief [Internal use] A task that depends on a single future to start executing (can start as soon as that future completes) */
 template<typename R, typename Func, typename T>
-class ContinuationTaskFromOneFuture : public PromiseFuturePair<R> {
+class ContinuationTaskFromOneFuture : public PromiseFuturePair<R>,
+    public ContinuationNode<ContinuationTaskFromOneFuture<R, Func, T> > {
 public:
     ContinuationTaskFromOneFuture(Executor* pExecutor, Func func, Future<T> future)
         :m_pExecutor(pExecutor),
@@ -277,9 +407,10 @@ public:
     {
     }
 
-    static void onFutureCompleted(std::shared_ptr<ContinuationTaskFromOneFuture> pThis) {
+    static void onFutureCompleted(RefPtr<ContinuationTaskFromOneFuture> pThis) {
         if(pThis->m_future.isCompletedNormally()) {
-            pThis->m_pExecutor->enqueue([pThis]() noexcept {
+            auto* pRaw = pThis.get();
+            carpal_private::enqueueOrFail(pRaw->m_pExecutor, pRaw, [pThis=std::move(pThis)]() noexcept {
                 pThis->computeAndSet(std::move(pThis->m_func), pThis->m_future.get());
                 pThis->m_future.reset();
             });
@@ -297,18 +428,20 @@ private:
 
 /** @brief [Internal use] A task that depends on a single void future to start executing (can start as soon as that future completes) */
 template<typename R, typename Func>
-class ContinuationTaskFromOneVoidFuture : public PromiseFuturePair<R> {
+class ContinuationTaskFromOneVoidFuture : public PromiseFuturePair<R>,
+    public ContinuationNode<ContinuationTaskFromOneVoidFuture<R, Func> > {
 public:
-    ContinuationTaskFromOneVoidFuture(Executor* pExecutor, Func func, std::shared_ptr<PromiseFuturePairBase > pFuture)
+    ContinuationTaskFromOneVoidFuture(Executor* pExecutor, Func func, RefPtr<PromiseFuturePairBase> pFuture)
         :m_pExecutor(pExecutor),
         m_func(std::move(func)),
-        m_pFuture(pFuture)
+        m_pFuture(std::move(pFuture))
     {
     }
 
-    static void onFutureCompleted(std::shared_ptr<ContinuationTaskFromOneVoidFuture> pThis) {
+    static void onFutureCompleted(RefPtr<ContinuationTaskFromOneVoidFuture> pThis) {
         if(pThis->m_pFuture->isCompletedNormally()) {
-            pThis->m_pExecutor->enqueue([pThis]() noexcept {
+            auto* pRaw = pThis.get();
+            carpal_private::enqueueOrFail(pRaw->m_pExecutor, pRaw, [pThis=std::move(pThis)]() noexcept {
                 pThis->computeAndSet(std::move(pThis->m_func));
                 pThis->m_pFuture.reset();
             });
@@ -321,26 +454,34 @@ public:
 private:
     Executor* m_pExecutor;
     Func m_func;
-    std::shared_ptr<PromiseFuturePairBase> m_pFuture;
+    RefPtr<PromiseFuturePairBase> m_pFuture;
 };
 
 /** @brief [Internal use] A task that depends on a single future to start executing (can start as soon as that future completes),
 will take the value via const reference, and executes an asynchronous operation returning a future. */
 template<typename Func, typename T>
-class ContinuationAsyncTaskFromOneFuture : public PromiseFuturePair<typename std::invoke_result<Func,T>::type::BaseType> {
+class ContinuationAsyncTaskFromOneFuture : public PromiseFuturePair<typename std::invoke_result<Func,T>::type::BaseType>,
+    public ContinuationNode<ContinuationAsyncTaskFromOneFuture<Func, T> > {
 public:
     using ReturnFuture = typename std::invoke_result<Func,T>::type;
     using ReturnType = typename ReturnFuture::BaseType;
-    ContinuationAsyncTaskFromOneFuture(Executor* pExecutor, Func func, std::shared_ptr<PromiseFuturePair<T> > pFuture)
+    ContinuationAsyncTaskFromOneFuture(Executor* pExecutor, Func func, RefPtr<PromiseFuturePair<T> > pFuture)
         :m_pExecutor(pExecutor),
         m_func(std::move(func)),
-        m_pAntecessorFuture(pFuture)
+        m_pAntecessorFuture(std::move(pFuture))
     {
     }
 
-    static void onFutureCompleted(std::shared_ptr<ContinuationAsyncTaskFromOneFuture<Func, T> > pThis) {
+    static void onFutureCompleted(RefPtr<ContinuationAsyncTaskFromOneFuture<Func, T> > pThis) {
         if(pThis->m_pAntecessorFuture->isCompletedNormally()) {
-            pThis->m_pExecutor->enqueue([pThis]() noexcept {
+            auto* pRaw = pThis.get();
+            carpal_private::enqueueOrFail(pRaw->m_pExecutor, pRaw, [pThis=std::move(pThis)]() noexcept {
+                if(pThis->isCancellationRequested()) {
+                    pThis->setException(std::make_exception_ptr(OperationCanceledException()));
+                    pThis->m_pAntecessorFuture.reset();
+                    return;
+                }
+                carpal_private::CancellationStateScope scope(pThis->cancellationState());
                 pThis->m_pAsyncOpFuture = pThis->m_func(pThis->m_pAntecessorFuture->get()).getPromiseFuturePair();
                 pThis->m_pAsyncOpFuture->addSynchronousCallback([pThis](){
                     ContinuationAsyncTaskFromOneFuture<Func, T>::onInnerFutureCompleted(pThis);
@@ -354,9 +495,10 @@ public:
     }
 
 private:
-    static void onInnerFutureCompleted(std::shared_ptr<ContinuationAsyncTaskFromOneFuture<Func, T> > pThis) {
+    static void onInnerFutureCompleted(RefPtr<ContinuationAsyncTaskFromOneFuture<Func, T> > pThis) {
         if(pThis->m_pAsyncOpFuture->isCompletedNormally()) {
-            pThis->m_pExecutor->enqueue([pThis]() noexcept {
+            auto* pRaw = pThis.get();
+            carpal_private::enqueueOrFail(pRaw->m_pExecutor, pRaw, [pThis=std::move(pThis)]() noexcept {
                 pThis->setFromOtherFutureMove(pThis->m_pAsyncOpFuture);
                 pThis->m_pAsyncOpFuture.reset();
             });
@@ -368,27 +510,35 @@ private:
 
     Executor* m_pExecutor;
     Func m_func;
-    std::shared_ptr<PromiseFuturePair<T> > m_pAntecessorFuture;
-    std::shared_ptr<typename PromiseFuturePair<ReturnType>::ConsumerFacingType> m_pAsyncOpFuture;
+    RefPtr<PromiseFuturePair<T> > m_pAntecessorFuture;
+    RefPtr<typename PromiseFuturePair<ReturnType>::ConsumerFacingType> m_pAsyncOpFuture;
 };
 
 /** @brief [Internal use] A task that depends on a single future to start executing (can start as soon as that future completes),
 will take the value via const reference, and executes an asynchronous operation returning a future. */
 template<typename Func>
-class ContinuationAsyncTaskFromOneVoidFuture : public PromiseFuturePair<typename std::invoke_result<Func>::type::BaseType> {
+class ContinuationAsyncTaskFromOneVoidFuture : public PromiseFuturePair<typename std::invoke_result<Func>::type::BaseType>,
+    public ContinuationNode<ContinuationAsyncTaskFromOneVoidFuture<Func> > {
 public:
     using ReturnFuture = typename std::invoke_result<Func>::type;
     using ReturnType = typename ReturnFuture::BaseType;
-    ContinuationAsyncTaskFromOneVoidFuture(Executor* pExecutor, Func func, std::shared_ptr<PromiseFuturePairBase> pFuture)
+    ContinuationAsyncTaskFromOneVoidFuture(Executor* pExecutor, Func func, RefPtr<PromiseFuturePairBase> pFuture)
         :m_pExecutor(pExecutor),
         m_func(std::move(func)),
-        m_pAntecessorFuture(pFuture)
+        m_pAntecessorFuture(std::move(pFuture))
     {
     }
 
-    static void onFutureCompleted(std::shared_ptr<ContinuationAsyncTaskFromOneVoidFuture<Func> > pThis) {
+    static void onFutureCompleted(RefPtr<ContinuationAsyncTaskFromOneVoidFuture<Func> > pThis) {
         if(pThis->m_pAntecessorFuture->isCompletedNormally()) {
-            pThis->m_pExecutor->enqueue([pThis]() noexcept {
+            auto* pRaw = pThis.get();
+            carpal_private::enqueueOrFail(pRaw->m_pExecutor, pRaw, [pThis=std::move(pThis)]() noexcept {
+                if(pThis->isCancellationRequested()) {
+                    pThis->setException(std::make_exception_ptr(OperationCanceledException()));
+                    pThis->m_pAntecessorFuture.reset();
+                    return;
+                }
+                carpal_private::CancellationStateScope scope(pThis->cancellationState());
                 pThis->m_pAsyncOpFuture = pThis->m_func().getPromiseFuturePair();
                 pThis->m_pAsyncOpFuture->addSynchronousCallback([pThis](){
                     ContinuationAsyncTaskFromOneVoidFuture<Func>::onInnerFutureCompleted(pThis);
@@ -402,9 +552,10 @@ public:
     }
 
 private:
-    static void onInnerFutureCompleted(std::shared_ptr<ContinuationAsyncTaskFromOneVoidFuture<Func> > pThis) {
+    static void onInnerFutureCompleted(RefPtr<ContinuationAsyncTaskFromOneVoidFuture<Func> > pThis) {
         if(pThis->m_pAsyncOpFuture->isCompletedNormally()) {
-            pThis->m_pExecutor->enqueue([pThis]() noexcept {
+            auto* pRaw = pThis.get();
+            carpal_private::enqueueOrFail(pRaw->m_pExecutor, pRaw, [pThis=std::move(pThis)]() noexcept {
                 pThis->setFromOtherFutureMove(pThis->m_pAsyncOpFuture);
                 pThis->m_pAsyncOpFuture.reset();
             });
@@ -416,13 +567,20 @@ private:
 
     Executor* m_pExecutor;
     Func m_func;
-    std::shared_ptr<PromiseFuturePairBase> m_pAntecessorFuture;
-    std::shared_ptr<typename PromiseFuturePair<ReturnType>::ConsumerFacingType> m_pAsyncOpFuture;
+    RefPtr<PromiseFuturePairBase> m_pAntecessorFuture;
+    RefPtr<typename PromiseFuturePair<ReturnType>::ConsumerFacingType> m_pAsyncOpFuture;
 };
 
-/** @brief [Internal use] A task that executes an asynchronous loop body for as long as a looping condition is true, and completes afterwards */
+/** @brief [Internal use] A task that executes an asynchronous loop body for as long as a looping condition is true, and completes afterwards.
+ *
+ * While the body returns already completed futures, the loop iterates in place, without attaching to them. Otherwise, it attaches
+ * itself, as the (only) continuation node, to the body's future, and the loop goes on via the executor when that future completes.
+ * If the future completes while the node is being attached, the attaching thread goes on iterating; so, the stack never grows.
+ * The cancellation token of the loop is checked before each iteration.
+ * For @c T being @c void, the condition and the body take no arguments.*/
 template<typename T, typename FuncCond, typename FuncBody>
-class ContinuationTaskAsyncLoop : public PromiseFuturePair<T> {
+class ContinuationTaskAsyncLoop : public PromiseFuturePair<T>,
+    public ContinuationNode<ContinuationTaskAsyncLoop<T, FuncCond, FuncBody> > {
 public:
     ContinuationTaskAsyncLoop(Executor* pExecutor, FuncCond cond, FuncBody body, Future<T> future)
         :m_pExecutor(pExecutor),
@@ -432,65 +590,87 @@ public:
     {
     }
 
-    static void onFutureCompleted(std::shared_ptr<ContinuationTaskAsyncLoop<T, FuncCond, FuncBody> > pThis) {
-        if(pThis->m_currentFuture.isCompletedNormally()) {
-            if(pThis->m_cond(pThis->m_currentFuture.get())) {
-                pThis->m_currentFuture = pThis->m_body(pThis->m_currentFuture.get());
-                pThis->m_currentFuture.addSynchronousCallback([pThis](){ContinuationTaskAsyncLoop<T, FuncCond, FuncBody>::onFutureCompleted(pThis);});
-            } else {
-                pThis->setFromOtherFutureMove(pThis->m_currentFuture.getPromiseFuturePair());
-                pThis->m_currentFuture.reset();
-            }
-        } else {
-            pThis->setException(pThis->m_currentFuture.getException());
-            pThis->m_currentFuture.reset();
+    /** @brief Starts the loop once the initial future completes.*/
+    static void start(RefPtr<ContinuationTaskAsyncLoop> const& pThis) {
+        if(pThis->isCurrentFutureComplete(pThis)) {
+            iterate(pThis);
         }
     }
 
-private:
-    Executor* m_pExecutor;
-    FuncCond m_cond;
-    FuncBody m_body;
-    Future<T> m_currentFuture;
-};
+    static void onFutureCompleted(RefPtr<ContinuationTaskAsyncLoop> pThis) {
+        if(!pThis->m_isHandedOver.exchange(true, std::memory_order_acq_rel)) {
+            // still within isCurrentFutureComplete(), which goes on with the loop
+            return;
+        }
+        auto* pRaw = pThis.get();
+        carpal_private::enqueueOrFail(pRaw->m_pExecutor, pRaw, [pThis=std::move(pThis)]() noexcept {
+            iterate(pThis);
+        });
+    }
 
-template<typename T, typename FuncCond, typename FuncBody> // T must be void, but we leave it as template parameter to delay its instantiation
-class ContinuationTaskAsyncLoopVoid : public PromiseFuturePair<T> {
-public:
-    ContinuationTaskAsyncLoopVoid(Executor* pExecutor, FuncCond cond, FuncBody body, Future<T> future)
-        :m_pExecutor(pExecutor),
-        m_cond(std::move(cond)),
-        m_body(std::move(body)),
-        m_currentFuture(future)
-    {
+private:
+    /** @brief Returns true if the current future is complete, so that the caller must go on with the loop. Otherwise, attaches to
+     * the future, and the loop goes on from @c onFutureCompleted().*/
+    bool isCurrentFutureComplete(RefPtr<ContinuationTaskAsyncLoop> const& pThis) {
+        if(m_currentFuture.isComplete()) {
+            return true;
+        }
+        m_isHandedOver.store(false, std::memory_order_relaxed);
+        pThis->attachTo(*m_currentFuture.getPromiseFuturePair());
+        return m_isHandedOver.exchange(true, std::memory_order_acq_rel);
     }
 
-    static void onFutureCompleted(std::shared_ptr<ContinuationTaskAsyncLoopVoid<T, FuncCond, FuncBody> > pThis) {
-        if(pThis->m_currentFuture.isCompletedNormally()) {
-            if(pThis->m_cond()) {
-                pThis->m_currentFuture = pThis->m_body();
-                pThis->m_currentFuture.addSynchronousCallback([pThis](){ContinuationTaskAsyncLoopVoid<T, FuncCond, FuncBody>::onFutureCompleted(pThis);});
-            } else {
-                pThis->setFromOtherFutureMove(pThis->m_currentFuture.getPromiseFuturePair());
+    static void iterate(RefPtr<ContinuationTaskAsyncLoop> const& pThis) noexcept {
+        carpal_private::CancellationStateScope scope(pThis->cancellationState());
+        do {
+            if(pThis->isCancellationRequested()) {
+                pThis->setException(std::make_exception_ptr(OperationCanceledException()));
                 pThis->m_currentFuture.reset();
+                return;
             }
-        } else {
-            pThis->setException(pThis->m_currentFuture.getException());
-            pThis->m_currentFuture.reset();
-        }
+            if(!pThis->m_currentFuture.isCompletedNormally()) {
+                pThis->setException(pThis->m_currentFuture.getException());
+                pThis->m_currentFuture.reset();
+                return;
+            }
+            try {
+                bool isContinuing;
+                if constexpr(std::is_void_v<T>) {
+                    isContinuing = pThis->m_cond();
+                } else {
+                    isContinuing = pThis->m_cond(pThis->m_currentFuture.get());
+                }
+                if(!isContinuing) {
+                    pThis->setFromOtherFutureMove(pThis->m_currentFuture.getPromiseFuturePair());
+                    pThis->m_currentFuture.reset();
+                    return;
+                }
+                if constexpr(std::is_void_v<T>) {
+                    pThis->m_currentFuture = pThis->m_body();
+                } else {
+                    pThis->m_currentFuture = pThis->m_body(pThis->m_currentFuture.get());
+                }
+            } catch(...) {
+                pThis->setException(std::current_exception());
+                pThis->m_currentFuture.reset();
+                return;
+            }
+        } while(pThis->isCurrentFutureComplete(pThis));
     }
 
-private:
     Executor* m_pExecutor;
     FuncCond m_cond;
     FuncBody m_body;
     Future<T> m_currentFuture;
+    /** @brief Set by whichever comes second of the thread attaching to the current future and the future's completion*/
+    std::atomic<bool> m_isHandedOver{false};
 };
 
 /** @brief [Internal use] A task that, when the given future completes, completes moving its value on normal completion,
 or calls the given function on the exception. The function is synchronous and returns a @c T.*/
 template<typename T, typename Func>
-class ContinuationTaskCatchAll : public PromiseFuturePair<T> {
+class ContinuationTaskCatchAll : public PromiseFuturePair<T>,
+    public ContinuationNode<ContinuationTaskCatchAll<T, Func> > {
 public:
     ContinuationTaskCatchAll(Executor* pExecutor, Func func, Future<T> future)
         :m_pExecutor(pExecutor),
@@ -499,15 +679,16 @@ public:
     {
     }
 
-    void onFutureCompleted() {
-        if(m_future.isCompletedNormally()) {
-            this->setFromOtherFutureMove(m_future.getPromiseFuturePair());
-            m_future.reset();
+    static void onFutureCompleted(RefPtr<ContinuationTaskCatchAll<T, Func> > pThis) {
+        if(pThis->m_future.isCompletedNormally()) {
+            pThis->setFromOtherFutureMove(pThis->m_future.getPromiseFuturePair());
+            pThis->m_future.reset();
         } else {
-            std::exception_ptr pException = m_future.getException();
-            m_future.reset();
-            m_pExecutor->enqueue([this,pException](){
-                this->computeAndSet(std::move(m_func), pException);
+            std::exception_ptr pException = pThis->m_future.getException();
+            pThis->m_future.reset();
+            auto* pRaw = pThis.get();
+            carpal_private::enqueueOrFail(pRaw->m_pExecutor, pRaw, [pThis=std::move(pThis),pException](){
+                pThis->computeAndSet(std::move(pThis->m_func), pException);
             });
         }
     }
@@ -521,7 +702,8 @@ private:
 /** @brief [Internal use] A task that, when the given future completes, completes moving its value on normal completion,
 or calls the given function on the exception. The function is asynchronous and returns a @c Future<T>*/
 template<typename T, typename Func>
-class ContinuationTaskAsyncCatchAll : public PromiseFuturePair<T> {
+class ContinuationTaskAsyncCatchAll : public PromiseFuturePair<T>,
+    public ContinuationNode<ContinuationTaskAsyncCatchAll<T, Func> > {
 public:
     ContinuationTaskAsyncCatchAll(Executor* pExecutor, Func func, Future<T> future)
         :m_pExecutor(pExecutor),
@@ -531,7 +713,7 @@ public:
     {
     }
 
-    static void onFutureCompleted(std::shared_ptr<ContinuationTaskAsyncCatchAll<T, Func> > pThis) {
+    static void onFutureCompleted(RefPtr<ContinuationTaskAsyncCatchAll<T, Func> > pThis) {
         if(pThis->m_antecessorFuture.isCompletedNormally()) {
             pThis->setFromOtherFutureMove(pThis->m_antecessorFuture.getPromiseFuturePair());
             pThis->m_antecessorFuture.reset();
@@ -565,10 +747,11 @@ public:
     {
     }
 
-    static void onFutureCompleted(std::shared_ptr<ContinuationTask<R, Func, FutureArgs...> > pThis) {
+    static void onFutureCompleted(RefPtr<ContinuationTask<R, Func, FutureArgs...> > pThis) {
         unsigned old = pThis->m_remaining.fetch_sub(1);
         if (old == 1) {
-            pThis->m_pTp->enqueue([pThis]() noexcept {
+            auto* pRaw = pThis.get();
+            carpal_private::enqueueOrFail(pRaw->m_pTp, pRaw, [pThis=std::move(pThis)]() noexcept {
                 pThis->computeAndSetWithTuple(std::move(pThis->m_func), std::move(pThis->m_futures));
             });
         }
@@ -592,16 +775,17 @@ public:
         // empty
     }
 
-    static void attachContinuations(std::shared_ptr<ContinuationTaskArray<R, Func, Arg> > pThis) {
+    static void attachContinuations(RefPtr<ContinuationTaskArray<R, Func, Arg> > pThis) {
         for (auto& future : pThis->m_futures) {
             future.addSynchronousCallback([pThis]() {ContinuationTaskArray<R, Func, Arg>::onFutureCompleted(pThis); });
         }
     }
 
-    static void onFutureCompleted(std::shared_ptr<ContinuationTaskArray<R, Func, Arg> > pThis) {
+    static void onFutureCompleted(RefPtr<ContinuationTaskArray<R, Func, Arg> > pThis) {
         unsigned old = pThis->m_remaining.fetch_sub(1);
         if (old == 1) {
-            pThis->m_pTp->enqueue([pThis]() noexcept {
+            auto* pRaw = pThis.get();
+            carpal_private::enqueueOrFail(pRaw->m_pTp, pRaw, [pThis=std::move(pThis)]() noexcept {
                 pThis->computeAndSet(std::move(pThis->m_func), std::move(pThis->m_futures));
             });
         }
@@ -614,7 +798,7 @@ public:
 };
 
 template<unsigned k, typename R, typename Func, typename... FutureArgs>
-void attachContinuations(std::shared_ptr<carpal_private::ContinuationTask<R, Func, FutureArgs...> > pTask) {
+void attachContinuations(RefPtr<carpal_private::ContinuationTask<R, Func, FutureArgs...> > pTask) {
     std::get<k-1>(pTask->m_futures).addSynchronousCallback([pTask]() {
         carpal_private::ContinuationTask<R, Func, FutureArgs...>::onFutureCompleted(pTask);
     });
@@ -628,6 +812,9 @@ void attachContinuations(std::shared_ptr<carpal_private::ContinuationTask<R, Fun
 template<typename T>
 Future<T> exceptionFuture(std::exception_ptr ex);
 
+template<typename T>
+Future<T> completedFuture(T val);
+
 /** @brief The consumer facing side of the promise-future pair.
  * */
 template<>
@@ -635,7 +822,7 @@ class Future<void> {
 public:
     using BaseType = void;
 
-    explicit Future(std::shared_ptr<PromiseFuturePairBase> pf)
+    explicit Future(RefPtr<PromiseFuturePairBase> pf)
         :m_pFuture(std::move(pf))
     {}
 
@@ -678,7 +865,7 @@ public:
         m_pFuture->addSynchronousCallback(std::move(func));
     }
 
-    std::shared_ptr<PromiseFuturePairBase> getPromiseFuturePair() const {
+    RefPtr<PromiseFuturePairBase> getPromiseFuturePair() const {
         return m_pFuture;
     }
 
@@ -689,10 +876,10 @@ public:
     Future<typename std::invoke_result<Func>::type>
     then(Executor* pExecutor, Func func) {
         using R = typename std::invoke_result<Func>::type;
-        std::shared_ptr<carpal_private::ContinuationTaskFromOneVoidFuture<R, Func> > pRet
-            = std::make_shared<carpal_private::ContinuationTaskFromOneVoidFuture<R, Func> >(
+        RefPtr<carpal_private::ContinuationTaskFromOneVoidFuture<R, Func> > pRet
+            = makeRefCounted<carpal_private::ContinuationTaskFromOneVoidFuture<R, Func> >(
             pExecutor, std::move(func), this->getPromiseFuturePair());
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskFromOneVoidFuture<R, Func>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<R>(pRet);
     }
 
@@ -703,13 +890,24 @@ public:
     Future<typename std::invoke_result<Func>::type>
     then(Func func) {
         using R = typename std::invoke_result<Func>::type;
-        std::shared_ptr<carpal_private::ContinuationTaskFromOneVoidFuture<R, Func> > pRet
-            = std::make_shared<carpal_private::ContinuationTaskFromOneVoidFuture<R, Func> >(
+        RefPtr<carpal_private::ContinuationTaskFromOneVoidFuture<R, Func> > pRet
+            = makeRefCounted<carpal_private::ContinuationTaskFromOneVoidFuture<R, Func> >(
             defaultExecutor(), std::move(func), this->getPromiseFuturePair());
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskFromOneVoidFuture<R, Func>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<R>(pRet);
     }
 
+    /** @brief Sets the given function to execute, on the thread that completes the current future (or on the current
+     * thread, if already completed), after the current future completes. Meant for short, non-blocking functions.
+     * @return A future that completes with the value (or exception) returned by the given function.
+     * @see InlineExecutor
+     * */
+    template<typename Func>
+    Future<typename std::invoke_result<Func>::type>
+    thenInline(Func func) {
+        return then(inlineExecutor(), std::move(func));
+    }
+
     /** @brief Sets the given asynchronous function to execute, on the given executor, after the current future completes.
      * @return A future that completes when the future returned by @c func completes.
      * */
@@ -717,10 +915,10 @@ public:
     Future<typename std::invoke_result<Func>::type::BaseType>
     thenAsync(Executor* pExecutor, Func func) {
         using R = typename std::invoke_result<Func>::type::BaseType;
-        std::shared_ptr<carpal_private::ContinuationAsyncTaskFromOneVoidFuture<Func> > pRet
-            = std::make_shared<carpal_private::ContinuationAsyncTaskFromOneVoidFuture<Func> >(
+        RefPtr<carpal_private::ContinuationAsyncTaskFromOneVoidFuture<Func> > pRet
+            = makeRefCounted<carpal_private::ContinuationAsyncTaskFromOneVoidFuture<Func> >(
             pExecutor, std::move(func), this->getPromiseFuturePair());
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationAsyncTaskFromOneVoidFuture<Func>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<R>(pRet);
     }
 
@@ -731,42 +929,39 @@ public:
     Future<typename std::invoke_result<Func>::type::BaseType>
     thenAsync(Func func) {
         using R = typename std::invoke_result<Func>::type::BaseType;
-        std::shared_ptr<carpal_private::ContinuationAsyncTaskFromOneVoidFuture<Func> > pRet
-            = std::make_shared<carpal_private::ContinuationAsyncTaskFromOneVoidFuture<Func> >(
+        RefPtr<carpal_private::ContinuationAsyncTaskFromOneVoidFuture<Func> > pRet
+            = makeRefCounted<carpal_private::ContinuationAsyncTaskFromOneVoidFuture<Func> >(
             defaultExecutor(), std::move(func), this->getPromiseFuturePair());
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationAsyncTaskFromOneVoidFuture<Func>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<R>(pRet);
     }
 
     template<typename FuncCond, typename FuncBody>
     Future<void>
     thenAsyncLoop(Executor* pExecutor, FuncCond cond, FuncBody body) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncLoopVoid<void, FuncCond, FuncBody> >(
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskAsyncLoop<void, FuncCond, FuncBody> >(
             pExecutor, std::move(cond), std::move(body), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncLoopVoid<void, FuncCond, FuncBody>::onFutureCompleted(pRet);});
+        carpal_private::ContinuationTaskAsyncLoop<void, FuncCond, FuncBody>::start(pRet);
         return Future<void>(pRet);
     }
 
     template<typename FuncCond, typename FuncBody>
     Future<void>
     thenAsyncLoop(FuncCond cond, FuncBody body) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncLoopVoid<void, FuncCond, FuncBody> >(
-            defaultExecutor(), std::move(cond), std::move(body), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncLoopVoid<void, FuncCond, FuncBody>::onFutureCompleted(pRet);});
-        return Future<void>(pRet);
+        return thenAsyncLoop(defaultExecutor(), std::move(cond), std::move(body));
     }
 
     template<typename Func>
     Future<void> thenCatchAll(Executor* pExecutor, Func func) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskCatchAll<void, Func> >(pExecutor, std::move(func), *this);
-        this->addSynchronousCallback([pRet](){pRet->onFutureCompleted();});
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskCatchAll<void, Func> >(pExecutor, std::move(func), *this);
+        pRet->attachTo(*m_pFuture);
         return Future<void>(pRet);
     }
 
     template<typename Func>
     Future<void> thenCatchAll(Func func) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskCatchAll<void, Func> >(defaultExecutor(), std::move(func), *this);
-        this->addSynchronousCallback([pRet](){pRet->onFutureCompleted();});
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskCatchAll<void, Func> >(defaultExecutor(), std::move(func), *this);
+        pRet->attachTo(*m_pFuture);
         return Future<void>(pRet);
     }
 
@@ -779,9 +974,9 @@ public:
                 f(ex);
             }
         };
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskCatchAll<void, decltype(generalHandler)> >(
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskCatchAll<void, decltype(generalHandler)> >(
             pExecutor, std::move(generalHandler), *this);
-        this->addSynchronousCallback([pRet](){pRet->onFutureCompleted();});
+        pRet->attachTo(*m_pFuture);
         return Future<void>(pRet);
     }
 
@@ -794,23 +989,23 @@ public:
                 f(ex);
             }
         };
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskCatchAll<void, decltype(generalHandler)> >(
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskCatchAll<void, decltype(generalHandler)> >(
             defaultExecutor(), std::move(generalHandler), *this);
-        this->addSynchronousCallback([pRet](){pRet->onFutureCompleted();});
+        pRet->attachTo(*m_pFuture);
         return Future<void>(pRet);
     }
 
     template<typename Func>
     Future<void> thenCatchAllAsync(Executor* pExecutor, Func func) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncCatchAll<void, Func> >(pExecutor, std::move(func), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncCatchAll<void, Func>::onFutureCompleted(pRet);});
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskAsyncCatchAll<void, Func> >(pExecutor, std::move(func), *this);
+        pRet->attachTo(*m_pFuture);
         return Future<void>(pRet);
     }
 
     template<typename Func>
     Future<void> thenCatchAllAsync(Func func) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncCatchAll<void, Func> >(defaultExecutor(), std::move(func), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncCatchAll<void, Func>::onFutureCompleted(pRet);});
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskAsyncCatchAll<void, Func> >(defaultExecutor(), std::move(func), *this);
+        pRet->attachTo(*m_pFuture);
         return Future<void>(pRet);
     }
 
@@ -825,9 +1020,9 @@ public:
                 return exceptionFuture<void>(std::current_exception());
             }
         };
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncCatchAll<void, decltype(generalHandler)> >(pExecutor,
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskAsyncCatchAll<void, decltype(generalHandler)> >(pExecutor,
             std::move(generalHandler), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncCatchAll<void, decltype(generalHandler)>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<void>(pRet);
     }
 
@@ -842,9 +1037,9 @@ public:
                 return exceptionFuture<void>(std::current_exception());
             }
         };
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncCatchAll<void, decltype(generalHandler)> >(defaultExecutor(),
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskAsyncCatchAll<void, decltype(generalHandler)> >(defaultExecutor(),
             std::move(generalHandler), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncCatchAll<void, decltype(generalHandler)>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<void>(pRet);
     }
 
@@ -854,7 +1049,7 @@ public:
     }
 
 private:
-    std::shared_ptr<PromiseFuturePairBase> m_pFuture;
+    RefPtr<PromiseFuturePairBase> m_pFuture;
 };
 
 template<typename T>
@@ -862,7 +1057,7 @@ class Future {
 public:
     using BaseType = T;
 
-    explicit Future(std::shared_ptr<PromiseFuturePair<T> > pf)
+    explicit Future(RefPtr<PromiseFuturePair<T> > pf)
         :m_pFuture(std::move(pf))
     {}
 
@@ -903,7 +1098,7 @@ public:
         return Future<void>(m_pFuture);
     }
 
-    std::shared_ptr<PromiseFuturePair<T> > getPromiseFuturePair() const {
+    RefPtr<PromiseFuturePair<T> > getPromiseFuturePair() const {
         return m_pFuture;
     }
 
@@ -917,9 +1112,9 @@ public:
     Future<typename std::invoke_result<Func, T>::type>
     then(Executor* pExecutor, Func func) {
         using R = typename std::invoke_result<Func, T>::type;
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskFromOneFuture<R, Func, T> >(
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskFromOneFuture<R, Func, T> >(
             pExecutor, std::move(func), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskFromOneFuture<R, Func, T>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<R>(pRet);
     }
 
@@ -927,19 +1122,29 @@ public:
     Future<typename std::invoke_result<Func, T>::type>
     then(Func func) {
         using R = typename std::invoke_result<Func, T>::type;
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskFromOneFuture<R, Func, T> >(
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskFromOneFuture<R, Func, T> >(
             defaultExecutor(), std::move(func), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskFromOneFuture<R, Func, T>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<R>(pRet);
     }
 
+    /** @brief Same as @c then(), but executes the function on the thread that completes the current future (or on the
+     * current thread, if already completed). Meant for short, non-blocking functions.
+     * @see InlineExecutor
+     * */
+    template<typename Func>
+    Future<typename std::invoke_result<Func, T>::type>
+    thenInline(Func func) {
+        return then(inlineExecutor(), std::move(func));
+    }
+
     template<typename Func>
     Future<typename std::invoke_result<Func, T>::type::BaseType>
     thenAsync(Executor* pExecutor, Func func) {
         using R = typename std::invoke_result<Func, T>::type::BaseType;
-        auto pRet = std::make_shared<carpal_private::ContinuationAsyncTaskFromOneFuture<Func, T> >(
+        auto pRet = makeRefCounted<carpal_private::ContinuationAsyncTaskFromOneFuture<Func, T> >(
             pExecutor, std::move(func), this->getPromiseFuturePair());
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationAsyncTaskFromOneFuture<Func, T>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<R>(pRet);
     }
 
@@ -947,9 +1152,9 @@ public:
     Future<typename std::invoke_result<Func, T>::type::BaseType>
     thenAsync(Func func) {
         using R = typename std::invoke_result<Func, T>::type::BaseType;
-        auto pRet = std::make_shared<carpal_private::ContinuationAsyncTaskFromOneFuture<Func, T> >(
+        auto pRet = makeRefCounted<carpal_private::ContinuationAsyncTaskFromOneFuture<Func, T> >(
             defaultExecutor(), std::move(func), this->getPromiseFuturePair());
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationAsyncTaskFromOneFuture<Func, T>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<R>(pRet);
     }
 
@@ -969,32 +1174,29 @@ public:
     template<typename FuncCond, typename FuncBody>
     Future<T>
     thenAsyncLoop(Executor* pExecutor, FuncCond cond, FuncBody body) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncLoop<T, FuncCond, FuncBody> >(
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskAsyncLoop<T, FuncCond, FuncBody> >(
             pExecutor, std::move(cond), std::move(body), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncLoop<T, FuncCond, FuncBody>::onFutureCompleted(pRet);});
+        carpal_private::ContinuationTaskAsyncLoop<T, FuncCond, FuncBody>::start(pRet);
         return Future<T>(pRet);
     }
 
     template<typename FuncCond, typename FuncBody>
     Future<T>
     thenAsyncLoop(FuncCond cond, FuncBody body) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncLoop<T, FuncCond, FuncBody> >(
-            defaultExecutor(), std::move(cond), std::move(body), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncLoop<T, FuncCond, FuncBody>::onFutureCompleted(pRet);});
-        return Future<T>(pRet);
+        return thenAsyncLoop(defaultExecutor(), std::move(cond), std::move(body));
     }
 
     template<typename Func>
     Future<T> thenCatchAll(Executor* pExecutor, Func func) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskCatchAll<T, Func> >(pExecutor, std::move(func), *this);
-        this->addSynchronousCallback([pRet](){pRet->onFutureCompleted();});
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskCatchAll<T, Func> >(pExecutor, std::move(func), *this);
+        pRet->attachTo(*m_pFuture);
         return Future<T>(pRet);
     }
 
     template<typename Func>
     Future<T> thenCatchAll(Func func) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskCatchAll<T, Func> >(defaultExecutor(), std::move(func), *this);
-        this->addSynchronousCallback([pRet](){pRet->onFutureCompleted();});
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskCatchAll<T, Func> >(defaultExecutor(), std::move(func), *this);
+        pRet->attachTo(*m_pFuture);
         return Future<T>(pRet);
     }
 
@@ -1007,9 +1209,9 @@ public:
                 return f(ex);
             }
         };
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskCatchAll<T, decltype(generalHandler)> >(
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskCatchAll<T, decltype(generalHandler)> >(
             pExecutor, std::move(generalHandler), *this);
-        this->addSynchronousCallback([pRet](){pRet->onFutureCompleted();});
+        pRet->attachTo(*m_pFuture);
         return Future<T>(pRet);
     }
 
@@ -1022,23 +1224,23 @@ public:
                 return f(ex);
             }
         };
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskCatchAll<T, decltype(generalHandler)> >(
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskCatchAll<T, decltype(generalHandler)> >(
             defaultExecutor(), std::move(generalHandler), *this);
-        this->addSynchronousCallback([pRet](){pRet->onFutureCompleted();});
+        pRet->attachTo(*m_pFuture);
         return Future<T>(pRet);
     }
 
     template<typename Func>
     Future<T> thenCatchAllAsync(Executor* pExecutor, Func func) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncCatchAll<T, Func> >(pExecutor, std::move(func), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncCatchAll<T, Func>::onFutureCompleted(pRet);});
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskAsyncCatchAll<T, Func> >(pExecutor, std::move(func), *this);
+        pRet->attachTo(*m_pFuture);
         return Future<T>(pRet);
     }
 
     template<typename Func>
     Future<T> thenCatchAllAsync(Func func) {
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncCatchAll<T, Func> >(defaultExecutor(), std::move(func), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncCatchAll<T, Func>::onFutureCompleted(pRet);});
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskAsyncCatchAll<T, Func> >(defaultExecutor(), std::move(func), *this);
+        pRet->attachTo(*m_pFuture);
         return Future<T>(pRet);
     }
 
@@ -1053,11 +1255,9 @@ public:
                 return exceptionFuture<T>(std::current_exception());
             }
         };
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncCatchAll<T, decltype(generalHandler)> >(pExecutor,
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskAsyncCatchAll<T, decltype(generalHandler)> >(pExecutor,
             std::move(generalHandler), *this);
-        this->addSynchronousCallback([pRet](){
-            carpal_private::ContinuationTaskAsyncCatchAll<T, decltype(generalHandler)>::onFutureCompleted(pRet);
-        });
+        pRet->attachTo(*m_pFuture);
         return Future<T>(pRet);
     }
 
@@ -1072,14 +1272,14 @@ public:
                 return exceptionFuture<T>(std::current_exception());
             }
         };
-        auto pRet = std::make_shared<carpal_private::ContinuationTaskAsyncCatchAll<T, decltype(generalHandler)> >(defaultExecutor(),
+        auto pRet = makeRefCounted<carpal_private::ContinuationTaskAsyncCatchAll<T, decltype(generalHandler)> >(defaultExecutor(),
             std::move(generalHandler), *this);
-        this->addSynchronousCallback([pRet](){carpal_private::ContinuationTaskAsyncCatchAll<T, decltype(generalHandler)>::onFutureCompleted(pRet);});
+        pRet->attachTo(*m_pFuture);
         return Future<T>(pRet);
     }
 
 private:
-    std::shared_ptr<PromiseFuturePair<T> > m_pFuture;
+    RefPtr<PromiseFuturePair<T> > m_pFuture;
 };
 
 /** @brief The promise side of a promise-future pair */
@@ -1087,7 +1287,7 @@ template<typename T>
 class Promise {
 public:
     /** @brief Creates the promise-future pair */
-    Promise() :m_pf(std::make_shared<PromiseFuturePair<T> >()) {}
+    Promise() :m_pf(makeRefCounted<PromiseFuturePair<T> >()) {}
 
     /** @brief Sets the value into the promise-future pair. Makes the Future side complete.
     *    This function must be called exactly once in the lifetime of the Promise!*/
@@ -1105,14 +1305,14 @@ public:
         return Future<T>(m_pf);
     }
 private:
-    std::shared_ptr<PromiseFuturePair<T> > m_pf;
+    RefPtr<PromiseFuturePair<T> > m_pf;
 };
 
 template<>
 class Promise<void> {
 public:
     /** @brief Creates the promise-future pair */
-    Promise() :m_pf(std::make_shared<PromiseFuturePair<void> >()) {}
+    Promise() :m_pf(makeRefCounted<PromiseFuturePair<void> >()) {}
 
     /** @brief Makes the Future side complete.
     *    This function must be called exactly once in the lifetime of the Promise!*/
@@ -1130,7 +1330,7 @@ public:
         return Future<void>(m_pf);
     }
 private:
-    std::shared_ptr<PromiseFuturePair<void> > m_pf;
+    RefPtr<PromiseFuturePair<void> > m_pf;
 };
 
 /**
@@ -1144,8 +1344,8 @@ template<typename Func>
 Future<typename std::invoke_result<Func>::type>
 runAsync(Executor* tp, Func func) {
     using R = typename std::invoke_result<Func>::type;
-    std::shared_ptr<carpal_private::ReadyTask<R, Func> > pf = std::make_shared<carpal_private::ReadyTask<R, Func> >(std::move(func));
-    tp->enqueue([pf](){pf->execute();});
+    RefPtr<carpal_private::ReadyTask<R, Func> > pf = makeRefCounted<carpal_private::ReadyTask<R, Func> >(std::move(func));
+    carpal_private::enqueueOrFail(tp, pf.get(), [pf](){pf->execute();});
     return Future<R>(pf);
 }
 
@@ -1161,41 +1361,6 @@ runAsync(Func func) {
     return runAsync(defaultExecutor(), std::move(func));
 }
 
-namespace carpal_private {
-
-/**
- * @brief Given a completed future start, it executes loopingPredicate on it and, as long as it returns true, it enqueues 
- * @param executor
- * @param loopingPredicate
- * @param loopFunc
- * @param start
- * @param ret
- */
-template<typename R, typename LoopFunc, typename PredicateFunc>
-void auxLoop(Executor* pExecutor, PredicateFunc loopingPredicate, LoopFunc loopFunc, R const& start, std::shared_ptr<PromiseFuturePair<R> > ret)
-{
-    if(!loopingPredicate(start)) {
-        ret->set(start);
-        return;
-    }
-
-    try {
-        Future<R> tmpResFuture = loopFunc(start);
-        tmpResFuture.addSynchronousCallback([pExecutor,loopingPredicate,loopFunc,tmpResFuture,ret](){
-            pExecutor->enqueue([pExecutor,loopingPredicate,loopFunc,tmpResFuture,ret](){
-                if(tmpResFuture.isException()) {
-                    ret->setException(tmpResFuture.getException());
-                } else {
-                    auxLoop(pExecutor, loopingPredicate, loopFunc, tmpResFuture.get(), ret);
-                }
-            });
-        });
-    } catch(...) {
-        ret->setException(std::current_exception());
-    }
-}
-} // namespace carpal_private
-
 /**
  * @brief Arranges that the given function executes when all pre-requisites are available. This version takes a function that takes the actual values as arguments.
  * @warning Someone must keep the returned future and wait on it to complete! Destroying the returned future without waiting on it will lead to undefined behavior!
@@ -1212,8 +1377,8 @@ Future<typename std::invoke_result<Func, T&...>::type>
 whenAll(Executor* pTp, Func func, Future<T>... futures) {
     using R = typename std::invoke_result<Func, T&...>::type;
     auto fwdFunc = [func](Future<T>... ff) -> R {return func(ff.get()...);};
-    std::shared_ptr<carpal_private::ContinuationTask<R, decltype(fwdFunc), Future<T>...> > pRet
-        = std::make_shared<carpal_private::ContinuationTask<R, decltype(fwdFunc), Future<T>...> >(
+    RefPtr<carpal_private::ContinuationTask<R, decltype(fwdFunc), Future<T>...> > pRet
+        = makeRefCounted<carpal_private::ContinuationTask<R, decltype(fwdFunc), Future<T>...> >(
         pTp, fwdFunc, futures...);
     carpal_private::attachContinuations<sizeof...(T)>(pRet);
     return Future<R>(pRet);
@@ -1234,8 +1399,8 @@ Future<typename std::invoke_result<Func, T&...>::type>
 whenAll(Func func, Future<T>... futures) {
     using R = typename std::invoke_result<Func, T&...>::type;
     auto fwdFunc = [func](Future<T>... ff) -> R {return func(ff.get()...);};
-    std::shared_ptr<carpal_private::ContinuationTask<R, decltype(fwdFunc), Future<T>...> > pRet
-        = std::make_shared<carpal_private::ContinuationTask<R, decltype(fwdFunc), Future<T>...> >(
+    RefPtr<carpal_private::ContinuationTask<R, decltype(fwdFunc), Future<T>...> > pRet
+        = makeRefCounted<carpal_private::ContinuationTask<R, decltype(fwdFunc), Future<T>...> >(
         defaultExecutor(), fwdFunc, futures...);
     carpal_private::attachContinuations<sizeof...(T)>(pRet);
     return Future<R>(pRet);
@@ -1255,8 +1420,8 @@ template<typename Func, typename... T>
 Future<typename std::invoke_result<Func, Future<T>...>::type>
 whenAllFromFutures(Executor* pTp, Func func, Future<T>... futures) {
     using R = typename std::invoke_result<Func, Future<T>...>::type;
-    std::shared_ptr<carpal_private::ContinuationTask<R, Func, Future<T>...> > pRet
-        = std::make_shared<carpal_private::ContinuationTask<R, Func, Future<T>...> >(pTp, func, futures...);
+    RefPtr<carpal_private::ContinuationTask<R, Func, Future<T>...> > pRet
+        = makeRefCounted<carpal_private::ContinuationTask<R, Func, Future<T>...> >(pTp, func, futures...);
     carpal_private::attachContinuations<sizeof...(T)>(pRet);
     return Future<R>(pRet);
 }
@@ -1275,8 +1440,8 @@ template<typename Func, typename... T>
 Future<typename std::invoke_result<Func, Future<T>...>::type>
 whenAllFromFutures(Func func, Future<T>... futures) {
     using R = typename std::invoke_result<Func, Future<T>...>::type;
-    std::shared_ptr<carpal_private::ContinuationTask<R, Func, Future<T>...> > pRet
-        = std::make_shared<carpal_private::ContinuationTask<R, Func, Future<T>...> >(defaultExecutor(), func, futures...);
+    RefPtr<carpal_private::ContinuationTask<R, Func, Future<T>...> > pRet
+        = makeRefCounted<carpal_private::ContinuationTask<R, Func, Future<T>...> >(defaultExecutor(), func, futures...);
     carpal_private::attachContinuations<sizeof...(T)>(pRet);
     return Future<R>(pRet);
 }
@@ -1285,8 +1450,8 @@ template<typename Func, typename T>
 Future<typename std::invoke_result<Func, std::vector<Future<T> > >::type>
 whenAllFromArrayOfFutures(Executor* pTp, Func func, std::vector<Future<T> > futures) {
     using R = typename std::invoke_result<Func, std::vector<Future<T> > >::type;
-    std::shared_ptr<carpal_private::ContinuationTaskArray<R, Func, T> > pRet
-        = std::make_shared<carpal_private::ContinuationTaskArray<R, Func, T> >(pTp, std::move(func), std::move(futures));
+    RefPtr<carpal_private::ContinuationTaskArray<R, Func, T> > pRet
+        = makeRefCounted<carpal_private::ContinuationTaskArray<R, Func, T> >(pTp, std::move(func), std::move(futures));
     carpal_private::ContinuationTaskArray<R, Func, T>::attachContinuations(pRet);
     return Future<R>(pRet);
 }
@@ -1295,12 +1460,247 @@ template<typename Func, typename T>
 Future<typename std::invoke_result<Func, std::vector<Future<T> > >::type>
 whenAllFromArrayOfFutures(Func func, std::vector<Future<T> > futures) {
     using R = typename std::invoke_result<Func, std::vector<Future<T> > >::type;
-    std::shared_ptr<carpal_private::ContinuationTaskArray<R, Func, T> > pRet
-        = std::make_shared<carpal_private::ContinuationTaskArray<R, Func, T> >(defaultExecutor(), std::move(func), std::move(futures));
+    RefPtr<carpal_private::ContinuationTaskArray<R, Func, T> > pRet
+        = makeRefCounted<carpal_private::ContinuationTaskArray<R, Func, T> >(defaultExecutor(), std::move(func), std::move(futures));
     carpal_private::ContinuationTaskArray<R, Func, T>::attachContinuations(pRet);
     return Future<R>(pRet);
 }
 
+namespace carpal_private {
+
+template<typename T>
+struct WhenAnyResultType {
+    using type = std::pair<size_t, T>;
+};
+
+template<>
+struct WhenAnyResultType<void> {
+    using type = size_t;
+};
+
+/** @brief [Internal use] The state of a @c whenAny() call.
+ *
+ * It holds one callback node per input, and no reference to the inputs. The result is referenced only until the first input
+ * completes; so, a slow input keeps alive only this state, not the result.*/
+template<typename T>
+class WhenAnyState : public RefCounted {
+public:
+    using R = typename WhenAnyResultType<T>::type;
+    using InputType = typename PromiseFuturePair<T>::ConsumerFacingType;
+
+    explicit WhenAnyState(size_t nrInputs)
+        :m_pResult(makeRefCounted<PromiseFuturePair<R> >()),
+        m_nodes(nrInputs)
+    {}
+
+    static Future<R> attach(RefPtr<WhenAnyState> pThis, std::vector<Future<T> > const& futures) {
+        Future<R> ret(pThis->m_pResult);
+        for(size_t i=0 ; i<futures.size() ; ++i) {
+            InputNode& node = pThis->m_nodes[i];
+            node.m_pState = pThis.get();
+            node.m_pInput = futures[i].getPromiseFuturePair().get();
+            node.m_index = i;
+            pThis->addRef();
+            futures[i].getPromiseFuturePair()->addCallbackNode(&node);
+        }
+        return ret;
+    }
+
+private:
+    class InputNode : public CallbackNode {
+    public:
+        void execute() noexcept override {
+            m_pState->onInputCompleted(m_pInput, m_index);
+            m_pState->release();
+        }
+        void discard() noexcept override {
+            m_pState->release();
+        }
+
+        WhenAnyState* m_pState = nullptr;
+        InputType* m_pInput = nullptr;
+        size_t m_index = 0;
+    };
+
+    void onInputCompleted(InputType* pInput, size_t index) noexcept {
+        if(m_isDone.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+        RefPtr<PromiseFuturePair<R> > pResult = std::move(m_pResult);
+        if(pInput->isException()) {
+            pResult->setException(pInput->getException());
+            return;
+        }
+        if constexpr(std::is_void_v<T>) {
+            pResult->set(index);
+        } else {
+            try {
+                pResult->set(R(index, pInput->get()));
+            } catch(...) {
+                pResult->setException(std::current_exception());
+            }
+        }
+    }
+
+    std::atomic<bool> m_isDone{false};
+    RefPtr<PromiseFuturePair<R> > m_pResult;
+    std::vector<InputNode> m_nodes;
+};
+
+} // namespace carpal_private
+
+/**
+ * @brief Returns a future that completes when the first of the given futures completes, with the index of that future and a copy of its value
+ * (just the index, for @c Future<void>) or, if it completed with an exception, with that exception.
+ * 
+ * The returned future does not keep the other futures alive; each of them keeps only a small state until it completes.
+ * The given vector must not be empty.
+ */
+template<typename T>
+Future<typename carpal_private::WhenAnyResultType<T>::type>
+whenAny(std::vector<Future<T> > futures) {
+    using R = typename carpal_private::WhenAnyResultType<T>::type;
+    if(futures.empty()) {
+        return exceptionFuture<R>(std::make_exception_ptr(std::invalid_argument("whenAny() needs at least one future")));
+    }
+    RefPtr<carpal_private::WhenAnyState<T> > pState = makeRefCounted<carpal_private::WhenAnyState<T> >(futures.size());
+    return carpal_private::WhenAnyState<T>::attach(std::move(pState), futures);
+}
+
+/**
+ * @brief Returns a future that completes when the first of the given futures completes; see the vector version above. The result
+ * index is the position of that future among the arguments.
+ */
+template<typename T, typename... U>
+Future<typename carpal_private::WhenAnyResultType<T>::type>
+whenAny(Future<T> first, Future<U>... others) {
+    static_assert((std::is_same_v<T, U> && ...), "whenAny() needs futures of the same type");
+    return whenAny(std::vector<Future<T> >{std::move(first), std::move(others)...});
+}
+
+namespace carpal_private {
+
+/** @brief [Internal use] A task that folds the values of the given futures, in the order they complete, into an accumulator.
+ *
+ * Like @c WhenAnyState, it holds one callback node per input and no reference to the inputs; an input is referenced only
+ * from its completion until its value is folded.*/
+template<typename R, typename T, typename Reducer>
+class WhenAllReduceTask : public PromiseFuturePair<R> {
+public:
+    WhenAllReduceTask(Executor* pExecutor, size_t nrInputs, R init, Reducer reducer)
+        :m_pExecutor(pExecutor),
+        m_remaining(nrInputs),
+        m_acc(std::move(init)),
+        m_reducer(std::move(reducer)),
+        m_nodes(nrInputs)
+    {}
+
+    static void attach(RefPtr<WhenAllReduceTask> const& pThis, std::vector<Future<T> > const& futures) {
+        for(size_t i=0 ; i<futures.size() ; ++i) {
+            InputNode& node = pThis->m_nodes[i];
+            node.m_pTask = pThis.get();
+            node.m_pInput = futures[i].getPromiseFuturePair().get();
+            pThis->addRef();
+            futures[i].getPromiseFuturePair()->addCallbackNode(&node);
+        }
+    }
+
+private:
+    class InputNode : public CallbackNode {
+    public:
+        void execute() noexcept override {
+            RefPtr<WhenAllReduceTask> pTask = RefPtr<WhenAllReduceTask>::adopt(m_pTask);
+            RefPtr<PromiseFuturePair<T> > pInput(m_pInput);
+            WhenAllReduceTask* pRaw = pTask.get();
+            Runnable task([pTask=std::move(pTask), pInput=std::move(pInput)]() noexcept {
+                pTask->fold(*pInput);
+            });
+            if(!pRaw->m_pExecutor->tryEnqueue(task)) {
+                pRaw->fail(std::make_exception_ptr(ExecutorRejectedException()));
+            }
+        }
+        void discard() noexcept override {
+            m_pTask->release();
+        }
+
+        WhenAllReduceTask* m_pTask = nullptr;
+        PromiseFuturePair<T>* m_pInput = nullptr;
+    };
+
+    void fold(PromiseFuturePair<T>& input) noexcept {
+        std::unique_lock<std::mutex> lck(m_mutex);
+        if(m_isDone) return;
+        if(input.isException()) {
+            lck.unlock();
+            fail(input.getException());
+            return;
+        }
+        try {
+            m_acc = std::invoke(m_reducer, std::move(m_acc), input.get());
+        } catch(...) {
+            lck.unlock();
+            fail(std::current_exception());
+            return;
+        }
+        if(--m_remaining == 0) {
+            m_isDone = true;
+            R acc = std::move(m_acc);
+            lck.unlock();
+            this->set(std::move(acc));
+        }
+    }
+
+    void fail(std::exception_ptr exception) noexcept {
+        std::unique_lock<std::mutex> lck(m_mutex);
+        if(m_isDone) return;
+        m_isDone = true;
+        lck.unlock();
+        this->setException(exception);
+    }
+
+    Executor* m_pExecutor;
+    std::mutex m_mutex;
+    size_t m_remaining;
+    bool m_isDone = false;
+    R m_acc;
+    Reducer m_reducer;
+    std::vector<InputNode> m_nodes;
+};
+
+} // namespace carpal_private
+
+/**
+ * @brief Returns a future that completes with the result of folding the values of the given futures into @c init, as they complete.
+ * @param pExecutor The executor where the folding is done; use @c inlineExecutor() for folding on the thread completing each future
+ * @param futures The futures whose values are folded
+ * @param init The initial value of the accumulator
+ * @param reducer A function taking the accumulator (an @c R, by value) and a value (a @c T&) and returning the new accumulator. The
+ * values are folded in the order the futures complete, one at a time. The reducer may move from the value if the caller does not
+ * use the futures otherwise.
+ * 
+ * Each value is folded as soon as its future completes, and the futures are not referenced afterwards; so, the memory taken by
+ * the results does not grow with the number of futures. If a future completes with an exception, or the reducer throws, the
+ * returned future completes immediately with that exception, and the remaining values are ignored.
+ */
+template<typename T, typename R, typename Reducer>
+Future<R> whenAllReduce(Executor* pExecutor, std::vector<Future<T> > futures, R init, Reducer reducer) {
+    if(futures.empty()) {
+        return completedFuture(std::move(init));
+    }
+    RefPtr<carpal_private::WhenAllReduceTask<R, T, Reducer> > pRet
+        = makeRefCounted<carpal_private::WhenAllReduceTask<R, T, Reducer> >(pExecutor, futures.size(), std::move(init), std::move(reducer));
+    carpal_private::WhenAllReduceTask<R, T, Reducer>::attach(pRet, futures);
+    return Future<R>(pRet);
+}
+
+/**
+ * @brief Same as above, folding the values on the default executor.
+ */
+template<typename T, typename R, typename Reducer>
+Future<R> whenAllReduce(std::vector<Future<T> > futures, R init, Reducer reducer) {
+    return whenAllReduce(defaultExecutor(), std::move(futures), std::move(init), std::move(reducer));
+}
+
 /**
  * @brief A function that returns an already completed future, with the provided value.
  */
@@ -1346,9 +1746,7 @@ Future<T> exceptionFuture(std::exception_ptr ex) {
 template<typename R, typename LoopFunc, typename PredicateFunc>
 Future<R> executeAsyncLoop(Executor* pExecutor, PredicateFunc loopingPredicate, LoopFunc loopFunc, R const& start)
 {
-    std::shared_ptr<PromiseFuturePair<R> > ret = std::make_shared<PromiseFuturePair<R> >();
-    carpal_private::auxLoop(pExecutor, loopingPredicate, loopFunc, start, ret);
-    return Future<R>(ret);
+    return completedFuture(start).thenAsyncLoop(pExecutor, std::move(loopingPredicate), std::move(loopFunc));
 }
 
 class FutureWaiter {
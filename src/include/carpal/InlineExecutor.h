@@ -0,0 +1,34 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include "Executor.h"
+
+namespace carpal {
+
+/** @brief An executor that executes each task immediately, on the thread calling @c enqueue().
+ *
+ * Used for continuations, this runs the continuation on the thread that completes the future it depends on, with no queueing
+ * and no thread switch. It is meant for short, non-blocking tasks.
+ *
+ * Since a task may complete futures whose continuations run, in turn, inline, the nesting depth is limited: if the current
+ * thread is already executing @c maxDepth inline tasks (through any @c InlineExecutor), the task is passed to the fallback
+ * executor instead.
+ * */
+class InlineExecutor : public Executor {
+public:
+    static constexpr unsigned defaultMaxDepth = 64;
+
+    /** @param pFallback The executor for the tasks that cannot be run inline; if null, @c defaultExecutor() is used.*/
+    explicit InlineExecutor(Executor* pFallback = nullptr, unsigned maxDepth = defaultMaxDepth);
+    void enqueue(Runnable func) override;
+    bool tryEnqueue(Runnable& func) override;
+
+private:
+    Executor* m_pFallback;
+    unsigned m_maxDepth;
+};
+
+} // namespace carpal
@@ -0,0 +1,68 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace carpal {
+
+/** @brief Returns the memory resource used for allocating the shared states (futures, continuations) created on the
+ * current thread, or @c nullptr if they are allocated with plain @c new (the default).
+ *
+ * The resource is chosen when an object is created; the object is returned to the same resource when its last reference
+ * is dropped, possibly on another thread. So, the resource must outlive all the objects allocated from it and must accept
+ * deallocations from any thread.*/
+std::pmr::memory_resource* currentMemoryResource() noexcept;
+
+/** @brief Sets the memory resource for the current thread (see @c currentMemoryResource()) and returns the previous one.*/
+std::pmr::memory_resource* setCurrentMemoryResource(std::pmr::memory_resource* pResource) noexcept;
+
+/** @brief Sets the memory resource for the current thread for the lifetime of the object, then restores the previous one.
+ *
+ * @note Only objects created by the current thread are affected; continuations created from tasks running on an executor
+ * use the memory resource set on the executor's thread.*/
+class MemoryResourceScope {
+public:
+    explicit MemoryResourceScope(std::pmr::memory_resource* pResource) noexcept
+        :m_pPrevious(setCurrentMemoryResource(pResource))
+    {}
+    ~MemoryResourceScope() {
+        setCurrentMemoryResource(m_pPrevious);
+    }
+    MemoryResourceScope(MemoryResourceScope const&) = delete;
+    MemoryResourceScope& operator=(MemoryResourceScope const&) = delete;
+
+private:
+    std::pmr::memory_resource* m_pPrevious;
+};
+
+/** @brief A memory resource keeping blocks of small sizes (up to @c maxPooledSize, rounded up to multiples of
+ * @c granularity) in per-thread free lists.
+ *
+ * Allocation and deallocation normally touch only the current thread's free list, without any locking. Blocks freed by a
+ * thread other than the one that allocated them go to the freeing thread's list. Lists that grow too large, and the lists
+ * of exiting threads, are given back to a shared list, from where other threads take blocks in batches. Memory is taken
+ * from the system in chunks and is never given back. Larger blocks are forwarded to @c operator @c new.
+ *
+ * Use @c threadLocalPoolResource() to get the instance.*/
+class ThreadLocalPoolResource : public std::pmr::memory_resource {
+public:
+    static constexpr std::size_t granularity = 16;
+    static constexpr std::size_t maxPooledSize = 512;
+
+private:
+    ThreadLocalPoolResource() = default;
+    friend ThreadLocalPoolResource* threadLocalPoolResource() noexcept;
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override;
+};
+
+/** @brief Returns the (unique) instance of @c ThreadLocalPoolResource. It is never destroyed.*/
+ThreadLocalPoolResource* threadLocalPoolResource() noexcept;
+
+} // namespace carpal
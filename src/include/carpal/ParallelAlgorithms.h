@@ -0,0 +1,220 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include "carpal/Executor.h"
+#include "carpal/Future.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace carpal {
+
+namespace carpal_private {
+
+/** @brief [Internal use] Returns the number of hardware threads, at least 1*/
+inline size_t parallelThreadCount() {
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+/** @brief [Internal use] Returns the grain size for a range of the given size: the size of the pieces the body is called on, that
+ * is, about 16 per hardware thread, so that the load can be balanced even if some pieces take longer.*/
+inline size_t parallelGrainSize(size_t size) {
+    return std::max<size_t>(1, size / (16 * parallelThreadCount()));
+}
+
+/** @brief [Internal use] A task that calls @c body on chunks of a range of indices, in parallel, and completes when all chunks are done.
+ *
+ * The splitting is lazy: a running chunk calls the body on one grain at a time and, before each grain, splits its upper half
+ * off into a new task, and so on, as long as fewer chunks than hardware threads wait in the executor queue, that is, as long
+ * as some thread may be idle. So, a loop on an idle executor is split in a logarithmic number of steps in about one chunk per
+ * thread, further splits happening only where the load is uneven, while a loop on a busy executor takes few tasks.
+ * The first exception thrown by the body is set into the future, once the running chunks end; the chunks not yet started are
+ * skipped. If @c R is not @c void, the future is set, at the end, to @c body.result().*/
+template<typename R, typename Body>
+class ParallelRangeTask : public PromiseFuturePair<R> {
+public:
+    ParallelRangeTask(Executor* pExecutor, size_t grain, Body body)
+        :m_pExecutor(pExecutor),
+        m_grain(grain),
+        m_maxQueued(parallelThreadCount()),
+        m_body(std::move(body))
+    {}
+
+    static void start(RefPtr<ParallelRangeTask> const& pThis, size_t begin, size_t end) {
+        pThis->enqueueChunk(pThis, begin, end);
+    }
+
+private:
+    void enqueueChunk(RefPtr<ParallelRangeTask> const& pThis, size_t begin, size_t end) noexcept {
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        m_nrQueued.fetch_add(1, std::memory_order_relaxed);
+        Runnable task([pThis, begin, end]() noexcept {
+            pThis->runChunk(pThis, begin, end);
+        });
+        if(!m_pExecutor->tryEnqueue(task)) {
+            m_nrQueued.fetch_sub(1, std::memory_order_relaxed);
+            fail(std::make_exception_ptr(ExecutorRejectedException()));
+            finishChunk();
+        }
+    }
+
+    void runChunk(RefPtr<ParallelRangeTask> const& pThis, size_t begin, size_t end) noexcept {
+        m_nrQueued.fetch_sub(1, std::memory_order_relaxed);
+        while(begin < end && !m_hasFailed.load(std::memory_order_relaxed)) {
+            while(end - begin > m_grain && m_nrQueued.load(std::memory_order_relaxed) < m_maxQueued) {
+                size_t mid = begin + (end - begin) / 2;
+                enqueueChunk(pThis, mid, end);
+                end = mid;
+            }
+            size_t pieceEnd = begin + std::min(m_grain, end - begin);
+            try {
+                m_body(begin, pieceEnd);
+            } catch(...) {
+                fail(std::current_exception());
+            }
+            begin = pieceEnd;
+        }
+        finishChunk();
+    }
+
+    void fail(std::exception_ptr exception) noexcept {
+        if(!m_hasFailed.exchange(true, std::memory_order_relaxed)) {
+            m_exception = exception;
+        }
+    }
+
+    void finishChunk() noexcept {
+        if(m_pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        if(m_exception != nullptr) {
+            this->setException(m_exception);
+        } else if constexpr(std::is_void_v<R>) {
+            this->set();
+        } else {
+            this->computeAndSet([this]() {return m_body.result();});
+        }
+    }
+
+    Executor* m_pExecutor;
+    size_t m_grain;
+    /** @brief Splitting stops while this many chunks wait in the executor queue*/
+    size_t m_maxQueued;
+    Body m_body;
+    std::atomic<size_t> m_pending{0};
+    /** @brief The chunks enqueued and not started yet*/
+    std::atomic<size_t> m_nrQueued{0};
+    std::atomic<bool> m_hasFailed{false};
+    std::exception_ptr m_exception = nullptr;
+};
+
+template<typename R, typename Body>
+Future<R> startParallelRange(Executor* pExecutor, size_t size, Body body) {
+    RefPtr<ParallelRangeTask<R, Body> > pTask
+        = makeRefCounted<ParallelRangeTask<R, Body> >(pExecutor, parallelGrainSize(size), std::move(body));
+    ParallelRangeTask<R, Body>::start(pTask, 0, size);
+    return Future<R>(pTask);
+}
+
+/** @brief [Internal use] Reduces chunks of a range, then folds the partial results, under a lock, into the accumulator.*/
+template<typename T, typename RandomIt, typename BinaryOp>
+class ParallelReduceBody {
+public:
+    ParallelReduceBody(RandomIt first, T init, BinaryOp op)
+        :m_first(first),
+        m_op(std::move(op)),
+        m_acc(std::move(init))
+    {}
+
+    ParallelReduceBody(ParallelReduceBody&& src)
+        :m_first(src.m_first),
+        m_op(std::move(src.m_op)),
+        m_acc(std::move(src.m_acc))
+    {}
+
+    void operator()(size_t begin, size_t end) {
+        T partial = m_first[begin];
+        for(size_t i=begin+1 ; i<end ; ++i) {
+            partial = m_op(std::move(partial), m_first[i]);
+        }
+        std::unique_lock<std::mutex> lck(m_mutex);
+        m_acc = m_op(std::move(m_acc), std::move(partial));
+    }
+
+    T result() {
+        return std::move(m_acc);
+    }
+
+private:
+    RandomIt m_first;
+    BinaryOp m_op;
+    std::mutex m_mutex;
+    T m_acc;
+};
+
+} // namespace carpal_private
+
+/**
+ * @brief Calls @c func(i) for each @c i in <tt>[begin, end)</tt>, in parallel, on the given executor.
+ * @return A future that completes when all the calls are done, or with the first exception thrown by @c func
+ *
+ * The range is split in chunks, each being a single task, only while some thread of the executor may be idle (see
+ * @c ParallelRangeTask); so, the cost of a call is about that of a plain loop. @c func is called concurrently from several threads.
+ */
+template<typename Func>
+Future<void> parallelFor(Executor* pExecutor, size_t begin, size_t end, Func func) {
+    if(end <= begin) {
+        return completedFuture();
+    }
+    return carpal_private::startParallelRange<void>(pExecutor, end - begin,
+        [begin, func=std::move(func)](size_t chunkBegin, size_t chunkEnd) {
+            for(size_t i=begin+chunkBegin ; i<begin+chunkEnd ; ++i) {
+                func(i);
+            }
+        });
+}
+
+/**
+ * @brief Sets <tt>*(out+i) = func(*(first+i))</tt> for each element of <tt>[first, last)</tt>, in parallel, on the given executor.
+ * @return A future that completes when all the elements are done, or with the first exception thrown by @c func
+ *
+ * The input and the output ranges must be kept alive until the returned future completes. See @c parallelFor().
+ */
+template<typename RandomIt, typename OutRandomIt, typename Func>
+Future<void> parallelTransform(Executor* pExecutor, RandomIt first, RandomIt last, OutRandomIt out, Func func) {
+    if(last <= first) {
+        return completedFuture();
+    }
+    return carpal_private::startParallelRange<void>(pExecutor, static_cast<size_t>(last - first),
+        [first, out, func=std::move(func)](size_t chunkBegin, size_t chunkEnd) {
+            for(size_t i=chunkBegin ; i<chunkEnd ; ++i) {
+                out[i] = func(first[i]);
+            }
+        });
+}
+
+/**
+ * @brief Returns a future that completes with the result of combining @c init and all the elements of <tt>[first, last)</tt>
+ * with @c op, computed in parallel on the given executor.
+ *
+ * @c op must be associative and commutative, since chunks of the range are reduced independently and their results are
+ * combined in the order the chunks end. The input range must be kept alive until the returned future completes.
+ */
+template<typename RandomIt, typename T, typename BinaryOp>
+Future<T> parallelReduce(Executor* pExecutor, RandomIt first, RandomIt last, T init, BinaryOp op) {
+    if(last <= first) {
+        return completedFuture(std::move(init));
+    }
+    return carpal_private::startParallelRange<T>(pExecutor, static_cast<size_t>(last - first),
+        carpal_private::ParallelReduceBody<T, RandomIt, BinaryOp>(first, std::move(init), std::move(op)));
+}
+
+} // namespace carpal
@@ -0,0 +1,194 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include "MemoryResource.h"
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace carpal {
+
+/** @brief Base class for objects that keep their own (atomic) reference count, to be managed by @see RefPtr.
+ *
+ * Compared to @c std::shared_ptr, there is no separate control block and the smart pointer is a single pointer wide.
+ * */
+class RefCounted {
+public:
+    RefCounted() noexcept = default;
+    RefCounted(RefCounted const&) = delete;
+    RefCounted& operator=(RefCounted const&) = delete;
+
+    void addRef() const noexcept {
+        m_refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** @brief Drops one reference; destroys the object when the last reference is dropped.*/
+    void release() const noexcept {
+        if(m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            destroy();
+        }
+    }
+
+protected:
+    virtual ~RefCounted() {}
+
+    /** @brief Called when the last reference is dropped.*/
+    virtual void destroy() const noexcept {
+        delete this;
+    }
+
+private:
+    mutable std::atomic<unsigned> m_refCount{0};
+};
+
+/** @brief Smart pointer to an object derived from @see RefCounted. */
+template<typename T>
+class RefPtr {
+public:
+    RefPtr() noexcept = default;
+
+    RefPtr(std::nullptr_t) noexcept {}
+
+    /** @brief Takes a new reference to the given object.*/
+    explicit RefPtr(T* p) noexcept
+        :m_p(p)
+    {
+        if(m_p != nullptr) m_p->addRef();
+    }
+
+    RefPtr(RefPtr const& src) noexcept
+        :RefPtr(src.m_p)
+    {}
+
+    RefPtr(RefPtr&& src) noexcept
+        :m_p(src.m_p)
+    {
+        src.m_p = nullptr;
+    }
+
+    template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+    RefPtr(RefPtr<U> const& src) noexcept
+        :RefPtr(src.get())
+    {}
+
+    template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+    RefPtr(RefPtr<U>&& src) noexcept
+        :m_p(src.detach())
+    {}
+
+    ~RefPtr() {
+        if(m_p != nullptr) m_p->release();
+    }
+
+    RefPtr& operator=(RefPtr src) noexcept {
+        std::swap(m_p, src.m_p);
+        return *this;
+    }
+
+    /** @brief Wraps a pointer whose reference is already owned by the caller, without taking a new one.*/
+    static RefPtr adopt(T* p) noexcept {
+        RefPtr ret;
+        ret.m_p = p;
+        return ret;
+    }
+
+    /** @brief Gives up ownership of the reference, without dropping it, and returns the raw pointer.*/
+    T* detach() noexcept {
+        T* ret = m_p;
+        m_p = nullptr;
+        return ret;
+    }
+
+    void reset() noexcept {
+        RefPtr tmp;
+        std::swap(m_p, tmp.m_p);
+    }
+
+    T* get() const noexcept {
+        return m_p;
+    }
+
+    T* operator->() const noexcept {
+        return m_p;
+    }
+
+    T& operator*() const noexcept {
+        return *m_p;
+    }
+
+    explicit operator bool() const noexcept {
+        return m_p != nullptr;
+    }
+
+    template<typename U>
+    bool operator==(RefPtr<U> const& other) const noexcept {
+        return m_p == other.get();
+    }
+
+    template<typename U>
+    bool operator!=(RefPtr<U> const& other) const noexcept {
+        return m_p != other.get();
+    }
+
+    bool operator==(std::nullptr_t) const noexcept {
+        return m_p == nullptr;
+    }
+
+    bool operator!=(std::nullptr_t) const noexcept {
+        return m_p != nullptr;
+    }
+
+private:
+    T* m_p = nullptr;
+};
+
+namespace carpal_private {
+
+/** @brief [Internal use] A reference counted object allocated from a memory resource, and given back to it when destroyed*/
+template<typename T>
+class ResourceAllocated final : public T {
+public:
+    template<typename... Args>
+    explicit ResourceAllocated(std::pmr::memory_resource* pResource, Args&&... args)
+        :T(std::forward<Args>(args)...)
+        ,m_pResource(pResource)
+    {}
+
+private:
+    void destroy() const noexcept override {
+        std::pmr::memory_resource* pResource = m_pResource;
+        ResourceAllocated* pThis = const_cast<ResourceAllocated*>(this);
+        pThis->~ResourceAllocated();
+        pResource->deallocate(pThis, sizeof(ResourceAllocated), alignof(ResourceAllocated));
+    }
+
+    std::pmr::memory_resource* m_pResource;
+};
+
+} // namespace carpal_private
+
+/** @brief Creates a reference counted object, the counterpart of @c std::make_shared().
+ *
+ * The object is allocated from @c currentMemoryResource(), if one is set, and with @c new otherwise.*/
+template<typename T, typename... Args>
+RefPtr<T> makeRefCounted(Args&&... args) {
+    std::pmr::memory_resource* pResource = currentMemoryResource();
+    if(pResource == nullptr) {
+        return RefPtr<T>(new T(std::forward<Args>(args)...));
+    }
+    using Allocated = carpal_private::ResourceAllocated<T>;
+    void* p = pResource->allocate(sizeof(Allocated), alignof(Allocated));
+    try {
+        return RefPtr<T>(::new(p) Allocated(pResource, std::forward<Args>(args)...));
+    } catch(...) {
+        pResource->deallocate(p, sizeof(Allocated), alignof(Allocated));
+        throw;
+    }
+}
+
+} // namespace carpal
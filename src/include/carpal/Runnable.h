@@ -0,0 +1,143 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace carpal {
+
+/** @brief A move-only function object taking no arguments and returning nothing, to be used as a task for an @c Executor.
+ *
+ * Unlike @c std::function<void()>, it does not require the wrapped function to be copyable, and it stores functions of up to
+ * @c inlineSize bytes (that can be moved without throwing) directly inside the object, without allocating memory.
+ * Larger functions are allocated on the heap.
+ * */
+class Runnable {
+public:
+    static constexpr std::size_t inlineSize = 64;
+
+    Runnable() noexcept = default;
+
+    Runnable(std::nullptr_t) noexcept {}
+
+    template<typename Func, typename = typename std::enable_if<!std::is_same<typename std::decay<Func>::type, Runnable>::value>::type>
+    Runnable(Func&& func) {
+        using F = typename std::decay<Func>::type;
+        if constexpr (isStoredInline<F>()) {
+            ::new(static_cast<void*>(&m_storage)) F(std::forward<Func>(func));
+            m_pOps = &InlineOps<F>::ops;
+        } else {
+            ::new(static_cast<void*>(&m_storage)) F*(new F(std::forward<Func>(func)));
+            m_pOps = &HeapOps<F>::ops;
+        }
+    }
+
+    Runnable(Runnable&& src) noexcept
+        :m_pOps(src.m_pOps)
+    {
+        if(m_pOps != nullptr) {
+            m_pOps->move(&m_storage, &src.m_storage);
+            src.m_pOps = nullptr;
+        }
+    }
+
+    Runnable& operator=(Runnable&& src) noexcept {
+        if(this != &src) {
+            reset();
+            if(src.m_pOps != nullptr) {
+                src.m_pOps->move(&m_storage, &src.m_storage);
+                m_pOps = src.m_pOps;
+                src.m_pOps = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Runnable(Runnable const&) = delete;
+    Runnable& operator=(Runnable const&) = delete;
+
+    ~Runnable() {
+        reset();
+    }
+
+    /** @brief Executes the wrapped function. Must not be called on an empty @c Runnable.*/
+    void operator()() {
+        m_pOps->invoke(&m_storage);
+    }
+
+    explicit operator bool() const noexcept {
+        return m_pOps != nullptr;
+    }
+
+    bool operator==(std::nullptr_t) const noexcept {
+        return m_pOps == nullptr;
+    }
+
+    bool operator!=(std::nullptr_t) const noexcept {
+        return m_pOps != nullptr;
+    }
+
+    /** @brief Destroys the wrapped function, leaving the @c Runnable empty.*/
+    void reset() noexcept {
+        if(m_pOps != nullptr) {
+            m_pOps->destroy(&m_storage);
+            m_pOps = nullptr;
+        }
+    }
+
+    /** @brief Returns true if a function of type @c F is stored without allocating memory.*/
+    template<typename F>
+    static constexpr bool isStoredInline() noexcept {
+        return sizeof(F) <= inlineSize && alignof(F) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<F>::value;
+    }
+
+private:
+    using Storage = typename std::aligned_storage<inlineSize, alignof(std::max_align_t)>::type;
+
+    struct Ops {
+        void (*invoke)(void* pStorage);
+        void (*move)(void* pDest, void* pSrc) noexcept;
+        void (*destroy)(void* pStorage) noexcept;
+    };
+
+    template<typename F>
+    struct InlineOps {
+        static void invoke(void* pStorage) {
+            (*static_cast<F*>(pStorage))();
+        }
+        static void move(void* pDest, void* pSrc) noexcept {
+            F* pSrcFunc = static_cast<F*>(pSrc);
+            ::new(pDest) F(std::move(*pSrcFunc));
+            pSrcFunc->~F();
+        }
+        static void destroy(void* pStorage) noexcept {
+            static_cast<F*>(pStorage)->~F();
+        }
+        static constexpr Ops ops = {&invoke, &move, &destroy};
+    };
+
+    template<typename F>
+    struct HeapOps {
+        static void invoke(void* pStorage) {
+            (**static_cast<F**>(pStorage))();
+        }
+        static void move(void* pDest, void* pSrc) noexcept {
+            ::new(pDest) F*(*static_cast<F**>(pSrc));
+        }
+        static void destroy(void* pStorage) noexcept {
+            delete *static_cast<F**>(pStorage);
+        }
+        static constexpr Ops ops = {&invoke, &move, &destroy};
+    };
+
+    Storage m_storage;
+    Ops const* m_pOps = nullptr;
+};
+
+} // namespace carpal
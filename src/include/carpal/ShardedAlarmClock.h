@@ -0,0 +1,83 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Timer.h"
+
+namespace carpal {
+
+/** @brief A set of independent alarm clocks (shards), each with its own lock, timer store and thread.
+ *
+ * Each calling thread is assigned a shard, in round-robin order, on its first use of any sharded clock; its timers are set on,
+ * and fire on, that shard. So, threads setting timers concurrently mostly do not contend on the same lock. Canceling a timer
+ * goes to the shard holding it, from any thread.
+ * */
+class ShardedAlarmClock {
+public:
+    /** @param nrShards The number of shards; 0 means one per hardware thread
+     * @param backend The timer store of each shard, as for @c AlarmClock
+     * @param tick The timing wheel resolution of each shard, as for @c AlarmClock*/
+    explicit ShardedAlarmClock(unsigned nrShards = 0, AlarmClock::Backend backend = AlarmClock::Backend::orderedSet,
+        std::chrono::nanoseconds tick = std::chrono::milliseconds(1));
+
+    unsigned nrShards() const {
+        return static_cast<unsigned>(m_shards.size());
+    }
+
+    AlarmClock& shard(unsigned index) {
+        return *m_shards[index];
+    }
+
+    /** @brief Returns the shard assigned to the calling thread*/
+    AlarmClock& currentShard();
+
+    /** @brief Closes all the shards*/
+    void close();
+
+    /** @brief Sets the default slack on all the shards*/
+    void setDefaultSlack(std::chrono::nanoseconds slack);
+
+    /** @brief Same as @c AlarmClock::setTimer(), on the current shard*/
+    template<typename... Args>
+    Timer setTimer(Args&&... args) {
+        return currentShard().setTimer(std::forward<Args>(args)...);
+    }
+
+    /** @brief Same as @c AlarmClock::setTimerAfter(), on the current shard*/
+    template<typename... Args>
+    Timer setTimerAfter(Args&&... args) {
+        return currentShard().setTimerAfter(std::forward<Args>(args)...);
+    }
+
+    /** @brief Same as @c AlarmClock::setTimedAction(), on the current shard*/
+    template<typename... Args>
+    auto setTimedAction(Args&&... args) {
+        return currentShard().setTimedAction(std::forward<Args>(args)...);
+    }
+
+    /** @brief Same as @c AlarmClock::setTimedActionAfter(), on the current shard*/
+    template<typename... Args>
+    auto setTimedActionAfter(Args&&... args) {
+        return currentShard().setTimedActionAfter(std::forward<Args>(args)...);
+    }
+
+    /** @brief Same as @c AlarmClock::setPeriodicTimer(), on the current shard*/
+    template<typename... Args>
+    Timer setPeriodicTimer(Args&&... args) {
+        return currentShard().setPeriodicTimer(std::forward<Args>(args)...);
+    }
+
+private:
+    std::vector<std::unique_ptr<AlarmClock> > m_shards;
+};
+
+/** @brief Returns a sharded alarm clock with one shard per hardware thread*/
+ShardedAlarmClock* shardedAlarmClock();
+
+} // namespace carpal
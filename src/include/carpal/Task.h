@@ -0,0 +1,278 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include "carpal/AsyncCoroutine.h"
+#include "carpal/CoroutineScheduler.h"
+#include "carpal/Future.h"
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+#include <assert.h>
+
+namespace carpal {
+
+    template<typename T>
+    class Task;
+
+namespace carpal_private {
+
+    /** @brief The part of the promise of a @c Task that does not depend on the result type.*/
+    class TaskPromiseBase : public CoroutineFrameAllocator {
+    public:
+        /** @brief Resumes the awaiting coroutine, if it is already suspended, by symmetric transfer; otherwise, the task
+         * completed synchronously, and the awaiting coroutine just goes on once @c Task::Awaiter::await_suspend() returns.*/
+        class FinalAwaiter {
+        public:
+            bool await_ready() const noexcept {
+                return false;
+            }
+            template<typename Promise>
+            std::coroutine_handle<void> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                TaskPromiseBase& promise = handle.promise();
+                if(promise.m_continuation != nullptr && promise.m_isStartedOrDone.exchange(true, std::memory_order_acq_rel)) {
+                    return promise.m_continuation;
+                }
+                return std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+
+        std::suspend_always initial_suspend() noexcept {
+            return std::suspend_always();
+        }
+        FinalAwaiter final_suspend() noexcept {
+            return FinalAwaiter();
+        }
+        void unhandled_exception() noexcept {
+            m_exception = std::current_exception();
+        }
+
+        /** @brief Suspends until the future completes; the task is then resumed via the scheduler of the awaiting
+         * coroutine or, if there is none, on the thread completing the future.*/
+        template<typename R>
+        FutureAwaiter<R> await_transform(Future<R> future) {
+            return FutureAwaiter<R>(m_pScheduler, future);
+        }
+
+        template<typename R>
+        typename Task<R>::Awaiter await_transform(Task<R>&& task) {
+            return typename Task<R>::Awaiter(task, m_pScheduler);
+        }
+
+        template<typename R>
+        typename Task<R>::Awaiter await_transform(Task<R>& task) {
+            return typename Task<R>::Awaiter(task, m_pScheduler);
+        }
+
+        /** @brief Runs the task, on the current thread, until it completes or suspends. Returns true if it suspended, in
+         * which case it resumes the awaiting coroutine when it completes.*/
+        bool start(std::coroutine_handle<void> self, std::coroutine_handle<void> continuation, AbstractCoroutineScheduler* pScheduler) {
+            m_continuation = continuation;
+            m_pScheduler = pScheduler;
+            self.resume();
+            return !m_isStartedOrDone.exchange(true, std::memory_order_acq_rel);
+        }
+
+    protected:
+        void rethrowIfFailed() {
+            if(m_exception != nullptr) {
+                std::rethrow_exception(m_exception);
+            }
+        }
+
+    private:
+        std::coroutine_handle<void> m_continuation = nullptr;
+        AbstractCoroutineScheduler* m_pScheduler = nullptr;
+        // Set by whichever comes second of the awaiter, once the task is started, and the task, once it completes.
+        std::atomic<bool> m_isStartedOrDone{false};
+        std::exception_ptr m_exception = nullptr;
+    };
+
+    template<typename T>
+    class TaskPromise : public TaskPromiseBase {
+    public:
+        Task<T> get_return_object();
+
+        void return_value(T val) {
+            m_val = std::move(val);
+        }
+
+        T result() {
+            rethrowIfFailed();
+            return std::move(m_val.value());
+        }
+
+    private:
+        std::optional<T> m_val;
+    };
+
+    template<>
+    class TaskPromise<void> : public TaskPromiseBase {
+    public:
+        Task<void> get_return_object();
+
+        void return_void() {}
+
+        void result() {
+            rethrowIfFailed();
+        }
+    };
+
+    /** @brief Eager, self-destroying coroutine used for running a @c Task from non-coroutine code.*/
+    class DetachedTaskRunner {
+    public:
+        class promise_type : public CoroutineFrameAllocator {
+        public:
+            DetachedTaskRunner get_return_object() {
+                return DetachedTaskRunner();
+            }
+            std::suspend_never initial_suspend() noexcept {
+                return std::suspend_never();
+            }
+            std::suspend_never final_suspend() noexcept {
+                return std::suspend_never();
+            }
+            void return_void() {}
+            void unhandled_exception() {
+                assert(false);
+            }
+            template<typename R>
+            typename Task<R>::Awaiter await_transform(Task<R>&& task) {
+                return typename Task<R>::Awaiter(task, nullptr);
+            }
+        };
+    };
+
+    template<typename T>
+    DetachedTaskRunner runTask(Task<T> task, Promise<T> promise) {
+        std::exception_ptr exception = nullptr;
+        try {
+            if constexpr(std::is_void_v<T>) {
+                co_await std::move(task);
+                promise.set();
+            } else {
+                promise.set(co_await std::move(task));
+            }
+        } catch(...) {
+            exception = std::current_exception();
+        }
+        if(exception != nullptr) {
+            promise.setException(exception);
+        }
+    }
+
+} // namespace carpal_private
+
+    /** @brief A lazy coroutine that produces a single value.
+     *
+     * Unlike @c AsyncCoroutine, the coroutine does not start when called; it starts when awaited, on the awaiting thread. If
+     * it completes synchronously, the awaiting coroutine simply goes on; otherwise, when it ends, it resumes the awaiting
+     * coroutine directly, by symmetric transfer. Either way, awaiting a task costs about as much as a function call, with no
+     * scheduler round-trip, and loops awaiting tasks do not grow the stack.
+     *
+     * A task may be awaited (once) from an @c AsyncCoroutine or from another task. A task awaiting a @c Future is resumed via the
+     * scheduler of the @c AsyncCoroutine awaiting it, directly or through other tasks; a task started via @c start() is resumed on
+     * the thread completing the future.
+     * */
+    template<typename T = void>
+    class Task {
+    public:
+        using promise_type = carpal_private::TaskPromise<T>;
+        class Awaiter;
+
+        explicit Task(std::coroutine_handle<promise_type> handle)
+            :m_handle(handle)
+        {
+            // nothing else
+        }
+
+        Task(Task const&) = delete;
+        Task& operator=(Task const&) = delete;
+        Task(Task&& src)
+            :m_handle(src.m_handle)
+        {
+            src.m_handle = nullptr;
+        }
+        Task& operator=(Task&& src) {
+            Task<T> tmp(std::move(src));
+            std::swap(m_handle, tmp.m_handle);
+            return *this;
+        }
+        /** @brief Destroys the coroutine. The task must either not have been started, or have finished.*/
+        ~Task() {
+            if(m_handle != nullptr) {
+                m_handle.destroy();
+            }
+        }
+
+        /** @brief Starts the task on the current thread, and returns a future that completes when the task ends.*/
+        Future<T> start() && {
+            Promise<T> promise;
+            Future<T> ret = promise.future();
+            carpal_private::runTask(std::move(*this), std::move(promise));
+            return ret;
+        }
+
+    private:
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    template<typename T>
+    class Task<T>::Awaiter {
+    public:
+        Awaiter(Task<T>& task, AbstractCoroutineScheduler* pScheduler)
+            :m_handle(task.m_handle),
+            m_pScheduler(pScheduler)
+        {
+            // nothing else
+        }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+        /** @brief Starts the task; returns false, so that the awaiting coroutine goes on without being suspended, if the task
+         * completed synchronously. Thus, loops awaiting such tasks do not grow the stack.*/
+        bool await_suspend(std::coroutine_handle<void> consumerHandler) {
+            return m_handle.promise().start(m_handle, consumerHandler, m_pScheduler);
+        }
+        T await_resume() {
+            return m_handle.promise().result();
+        }
+    private:
+        std::coroutine_handle<promise_type> m_handle;
+        AbstractCoroutineScheduler* m_pScheduler;
+    };
+
+namespace carpal_private {
+
+    template<typename T>
+    Task<T> TaskPromise<T>::get_return_object() {
+        return Task<T>(std::coroutine_handle<TaskPromise<T> >::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() {
+        return Task<void>(std::coroutine_handle<TaskPromise<void> >::from_promise(*this));
+    }
+
+} // namespace carpal_private
+
+    template<typename T>
+    template<typename R>
+    typename Task<R>::Awaiter AsyncCoroutine<T>::promise_type::await_transform(Task<R>&& task) {
+        return typename Task<R>::Awaiter(task, m_pScheduler);
+    }
+
+    template<typename T>
+    template<typename R>
+    typename Task<R>::Awaiter AsyncCoroutine<T>::promise_type::await_transform(Task<R>& task) {
+        return typename Task<R>::Awaiter(task, m_pScheduler);
+    }
+
+} // namespace carpal
@@ -16,9 +16,27 @@ namespace carpal {
 
 class ThreadPool : public Executor {
 public:
+    /** @brief What @c enqueue() does when the queue of a bounded pool is full*/
+    enum class OverflowPolicy {
+        block, ///< @brief Waits until there is room in the queue
+        reject, ///< @brief Refuses the task: @c enqueue() throws @c ExecutorRejectedException and @c tryEnqueue() returns false
+        runInCaller ///< @brief Executes the task immediately, on the calling thread
+    };
+
+    /** @brief Creates a pool with an unbounded queue*/
     explicit ThreadPool(unsigned nrThreads);
+
+    /** @brief Creates a pool whose queue holds at most @c capacity tasks; @c policy says what happens beyond that.
+     *
+     * @note Tasks enqueued by the pool's own threads (typically, continuations of computations running on the pool) are always
+     * accepted, even beyond capacity: blocking would risk deadlocking the pool, and rejecting would fail work that has already
+     * been admitted. So, backpressure applies to producers outside the pool.
+     * */
+    ThreadPool(unsigned nrThreads, size_t capacity, OverflowPolicy policy);
+
     ~ThreadPool() override;
-    void enqueue(std::function<void()> func) override;
+    void enqueue(Runnable func) override;
+    bool tryEnqueue(Runnable& func) override;
 
     void close();
 
@@ -27,7 +45,10 @@ private:
 
     std::mutex m_mtx;
     std::condition_variable m_cv;
-    std::deque<std::function<void()> > m_tasks;
+    std::condition_variable m_cvNotFull;
+    std::deque<Runnable> m_tasks;
+    size_t m_capacity = 0; ///< @brief 0 means unbounded
+    OverflowPolicy m_policy = OverflowPolicy::block;
     bool m_isClosed = false;
 
     std::vector<std::thread> m_threads;
@@ -6,9 +6,12 @@
 
 #include "Future.h"
 
+#include <atomic>
 #include <chrono>
-#include <set>
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <stdexcept>
 #include <thread>
 
 namespace carpal {
@@ -18,61 +21,413 @@ class AlarmClock;
 
 namespace carpal_private {
 
-class TimerFutureObject;    
+class TimerStore;
+class OrderedTimerStore;
+class TimingWheelTimerStore;
+class PeriodicTimerObject;
+
+/** @brief [Internal use] The future of a timer, together with the data needed by the @c AlarmClock*/
+class TimerFutureObject : public PromiseFuturePair<bool> {
+public:
+    TimerFutureObject(std::chrono::steady_clock::time_point const& when, std::chrono::nanoseconds slack, AlarmClock* pClock)
+        :m_when(when)
+        ,m_slack(slack)
+        ,m_pClock(pClock)
+    {
+        // nothing else
+    }
+protected:
+    friend AlarmClock;
+    friend Timer;
+    friend OrderedTimerStore;
+    friend TimingWheelTimerStore;
+
+    /** @brief Completes the future with the given value, unless already triggered or canceled. May be called without
+     * holding the alarm clock lock, concurrently with a @c cancel().*/
+    void complete(bool triggered) {
+        if(claimCompletion()) {
+            this->set(triggered);
+        }
+    }
+
+    /** @brief Returns true for the first caller, which must then complete the future; also stops watching the cancellation token,
+     * waiting for the cancellation callback if it is running on another thread, since that callback uses the alarm clock.*/
+    bool claimCompletion() noexcept {
+        if(m_isDone.exchange(true, std::memory_order_acq_rel)) {
+            return false;
+        }
+        stopWatchingCancellation();
+        return true;
+    }
+
+    /** @brief Unregisters the cancellation callback; called once, by whoever completes the timer.*/
+    void stopWatchingCancellation() noexcept {
+        if(m_isWatchingCancellation) {
+            this->cancellationState()->removeCallback(m_cancellationCallback);
+        }
+    }
+
+    /** @brief Called, on the alarm clock thread, when the timer expires*/
+    virtual void trigger() {
+        complete(true);
+    }
+
+    /** @brief The latest time the timer may fire at*/
+    std::chrono::steady_clock::time_point latest() const {
+        return (m_when > std::chrono::steady_clock::time_point::max() - m_slack) ? std::chrono::steady_clock::time_point::max() : m_when + m_slack;
+    }
+
+    std::chrono::steady_clock::time_point m_when;
+    std::chrono::nanoseconds m_slack;
+    AlarmClock* m_pClock;
+    std::atomic<bool> m_isDone{false};
+    /** @brief Set, before the timer is inserted, if canceling its cancellation token cancels the timer*/
+    bool m_isWatchingCancellation = false;
+    CancellationState::CallbackHandle m_cancellationCallback;
+
+    // Used by TimingWheelTimerStore, under the alarm clock lock
+    TimerFutureObject* m_pPrevInBucket = nullptr;
+    TimerFutureObject* m_pNextInBucket = nullptr;
+    uint64_t m_expiryTick = 0;
+    int m_bucket = -1; ///< @brief index of the list holding the timer, or -1 if not in the wheel
+};
+
+/** @brief [Internal use] A task that executes, on an executor, when a timer fires; if the timer is canceled, it completes with
+ * a @c TimerCanceledException, without executing.*/
+template<typename R, typename Func>
+class TimedActionTask : public PromiseFuturePair<R>,
+    public ContinuationNode<TimedActionTask<R, Func> > {
+public:
+    TimedActionTask(Executor* pExecutor, Func func, Future<bool> timerFuture)
+        :m_pExecutor(pExecutor),
+        m_func(std::move(func)),
+        m_timerFuture(timerFuture)
+    {
+    }
+
+    static void onFutureCompleted(RefPtr<TimedActionTask> pThis);
+
+private:
+    Executor* m_pExecutor;
+    Func m_func;
+    Future<bool> m_timerFuture;
+};
 
 } // namespace carpal_private
 
+/** @brief Set into the future returned by @c withTimeout() when the time runs out*/
+class TimeoutException : public std::runtime_error {
+public:
+    TimeoutException()
+        :std::runtime_error("timeout")
+    {}
+};
+
+/** @brief Set into the future of a @c TimedAction canceled before its deadline*/
+class TimerCanceledException : public std::runtime_error {
+public:
+    TimerCanceledException()
+        :std::runtime_error("timer canceled")
+    {}
+};
+
 class Timer {
 public:
-    Timer(std::shared_ptr<carpal_private::TimerFutureObject> pFuture)
+    Timer(RefPtr<carpal_private::TimerFutureObject> pFuture)
         :m_pFuture(pFuture)
         {}
     Future<bool> getFuture();
     void cancel();
 
 private:
-    std::shared_ptr<carpal_private::TimerFutureObject> m_pFuture;
+    RefPtr<carpal_private::TimerFutureObject> m_pFuture;
 };
 
+/** @brief An action scheduled, through an @c AlarmClock, to execute on an executor at a given time*/
 template<typename T>
 class TimedAction {
 public:
-    Future<T> getFuture() const;
-    operator Future<T>() const;
-    void cancel();
+    TimedAction(Timer timer, Future<T> future)
+        :m_timer(std::move(timer)),
+        m_future(std::move(future))
+    {}
+
+    /** @brief Returns a future that completes with the result of the action*/
+    Future<T> getFuture() const {
+        return m_future;
+    }
+
+    operator Future<T>() const {
+        return m_future;
+    }
+
+    /** @brief Cancels the action, unless its time has already come. A canceled action does not execute, and its future
+     * completes with a @c TimerCanceledException.*/
+    void cancel() {
+        m_timer.cancel();
+    }
+
+private:
+    Timer m_timer;
+    Future<T> m_future;
 };
 
 /** @brief An object that can be used for scheduling one-shot or periodic actions
+ *
+ * A timer set within a @c CancellationScope is canceled, as by @c Timer::cancel(), when the token of the scope is canceled.
  * */
 class AlarmClock {
 public:
+    /** @brief The data structure keeping the pending timers*/
+    enum class Backend {
+        /** @brief A balanced tree ordered by deadline: O(log n) for setting and canceling a timer; exact deadlines*/
+        orderedSet,
+        /** @brief A hierarchical timing wheel: O(1) for setting and canceling a timer. Deadlines are rounded up to a
+         * multiple of the tick, so timers fire up to one tick late. Suited to many timers, most of which are canceled.*/
+        timingWheel
+    };
+
+    /** @brief How a periodic timer computes its next deadline*/
+    enum class Schedule {
+        /** @brief The deadlines are the first one plus multiples of the period. Deadlines that pass while the previous
+         * execution is still running are skipped.*/
+        fixedRate,
+        /** @brief Each deadline is one period after the end of the previous execution*/
+        fixedDelay
+    };
+
     AlarmClock();
+    /** @param tick The resolution of the timing wheel; ignored by the @c orderedSet backend*/
+    explicit AlarmClock(Backend backend, std::chrono::nanoseconds tick = std::chrono::milliseconds(1));
+    /** @brief Closes the clock, then waits for the executions of the periodic timers that are already enqueued or running*/
     ~AlarmClock();
 
-    /** @brief Terminates the alarm clock. Events not triggered yet are canceled
+    /** @brief Terminates the alarm clock. Events not triggered yet are canceled, and so are the timers set afterwards.
      * */
     void close();
+    /** @brief Sets a timer that fires when the monotonic clock reaches the given time point*/
+    Timer setTimer(std::chrono::steady_clock::time_point when);
+    /** @brief Sets a timer that fires at the given wall-clock time. The time point is converted to the monotonic clock when the
+     * timer is set, so later adjustments of the wall clock do not move the timer.*/
     Timer setTimer(std::chrono::system_clock::time_point when);
-    Timer setTimerAfter(std::chrono::system_clock::duration delta);
+    /** @brief Sets a timer that fires after the given duration, measured on the monotonic clock*/
+    Timer setTimerAfter(std::chrono::steady_clock::duration delta);
+
+    /** @brief Like the functions above, but the timer may fire any time up to @c slack after the given time. The clock uses
+     * the slack to trigger, on a single wake-up, the timers whose allowed intervals overlap.*/
+    Timer setTimer(std::chrono::steady_clock::time_point when, std::chrono::nanoseconds slack);
+    Timer setTimer(std::chrono::system_clock::time_point when, std::chrono::nanoseconds slack);
+    Timer setTimerAfter(std::chrono::steady_clock::duration delta, std::chrono::nanoseconds slack);
+
+    /** @brief Sets the slack used for the timers set without specifying one. Initially, it is 0.*/
+    void setDefaultSlack(std::chrono::nanoseconds slack);
     
+    /** @brief Sets the given function to execute, on the given executor, at the given time (a time point of either
+     * @c std::chrono::steady_clock or @c std::chrono::system_clock).
+     *
+     * Only the dispatch to the executor is done on the alarm clock thread, so a long action does not delay other timers.*/
+    template<typename TimePoint, typename Func>
+    TimedAction<typename std::invoke_result<Func>::type> setTimedAction(TimePoint when, Executor* pExecutor, Func func);
+
+    /** @brief Sets the given function to execute, on the default executor, at the given time*/
+    template<typename TimePoint, typename Func>
+    TimedAction<typename std::invoke_result<Func>::type> setTimedAction(TimePoint when, Func func) {
+        return setTimedAction(when, defaultExecutor(), std::move(func));
+    }
+
+    /** @brief Sets the given function to execute, on the given executor, after the given duration*/
     template<typename Func>
-    Future<typename std::invoke_result<Func>::type> setTimedAction();
+    TimedAction<typename std::invoke_result<Func>::type> setTimedActionAfter(std::chrono::steady_clock::duration delta,
+            Executor* pExecutor, Func func) {
+        return setTimedAction(std::chrono::steady_clock::now() + delta, pExecutor, std::move(func));
+    }
 
-    void cancelTimer(std::shared_ptr<carpal_private::TimerFutureObject> pTimerObject);
+    /** @brief Sets the given function to execute, on the default executor, after the given duration*/
+    template<typename Func>
+    TimedAction<typename std::invoke_result<Func>::type> setTimedActionAfter(std::chrono::steady_clock::duration delta, Func func) {
+        return setTimedActionAfter(delta, defaultExecutor(), std::move(func));
+    }
+
+    /** @brief Sets the given function to execute, on the given executor, at @c first and then periodically, until the
+     * returned timer is canceled or the clock is closed.
+     *
+     * A single timer object is reused for all the executions, and executions never overlap: the timer is re-armed after
+     * each execution ends. The future of the returned timer completes with false when the timer stops, or with the
+     * exception thrown by @c func, if any (that also stops the timer). The clock may be destroyed while an execution is in
+     * progress, but not from within @c func, since the destructor waits for it.*/
+    Timer setPeriodicTimer(std::chrono::steady_clock::time_point first, std::chrono::steady_clock::duration period,
+        Executor* pExecutor, Runnable func, Schedule schedule = Schedule::fixedRate);
+
+    void cancelTimer(RefPtr<carpal_private::TimerFutureObject> pTimerObject);
 
 private:
-    static bool compareTimers(std::shared_ptr<carpal_private::TimerFutureObject> const& p,
-        std::shared_ptr<carpal_private::TimerFutureObject> const& q);
+    friend carpal_private::PeriodicTimerObject;
+
     void threadFunction();
+    /** @brief Sets the timer; an empty @c slack means the default one*/
+    Timer addTimer(std::chrono::steady_clock::time_point when, std::optional<std::chrono::nanoseconds> slack);
+    /** @brief Inserts the timer object into the store and wakes up the clock thread, if needed*/
+    void insertTimer(RefPtr<carpal_private::TimerFutureObject> const& pTimer, bool useDefaultSlack);
+    /** @brief Inserts again a periodic timer, after an execution, unless it was canceled or the clock was closed*/
+    void rearmTimer(RefPtr<carpal_private::TimerFutureObject> const& pTimer, std::chrono::steady_clock::time_point when);
+    /** @brief Counts an execution of a periodic timer, from its dispatch to the executor until it no longer uses the clock*/
+    void beginExecution();
+    void endExecution();
 
     std::mutex m_mtx;
     std::condition_variable m_cond;
-    std::set<std::shared_ptr<carpal_private::TimerFutureObject>, decltype(&AlarmClock::compareTimers)> m_timers;
-    std::shared_ptr<carpal_private::TimerFutureObject> m_nextTimer;
+    std::unique_ptr<carpal_private::TimerStore> m_pTimers;
+    std::chrono::nanoseconds m_defaultSlack{0};
     bool m_closed = false;
+    /** @brief The number of executions of periodic timers dispatched and not ended yet; the destructor waits for them*/
+    std::size_t m_nrExecutions = 0;
+    std::condition_variable m_executionsDone;
     std::thread m_thread;
 };
 
 AlarmClock* alarmClock();
 
+namespace carpal_private {
+
+/** @brief [Internal use] A timer that, each time it expires, executes a function on an executor and then re-arms itself*/
+class PeriodicTimerObject : public TimerFutureObject {
+public:
+    PeriodicTimerObject(std::chrono::steady_clock::time_point const& first, std::chrono::steady_clock::duration period,
+        AlarmClock::Schedule schedule, Executor* pExecutor, Runnable func, AlarmClock* pClock);
+
+private:
+    void trigger() override;
+    /** @brief Executes the function, then re-arms the timer*/
+    void execute();
+    /** @brief Stops the timer, completing its future with the given exception*/
+    void fail(std::exception_ptr exception);
+
+    std::chrono::steady_clock::duration m_period;
+    AlarmClock::Schedule m_schedule;
+    Executor* m_pExecutor;
+    Runnable m_func;
+};
+
+
+/** @brief [Internal use] A future that completes like the given one, or, if a timer fires first, with the result of the
+ * fallback function (which may throw a @c TimeoutException), executed on an executor.*/
+template<typename T, typename Fallback>
+class TimeoutTask : public PromiseFuturePair<T>,
+    public ContinuationNode<TimeoutTask<T, Fallback> > {
+public:
+    TimeoutTask(Executor* pExecutor, Future<T> future, Fallback fallback)
+        :m_pExecutor(pExecutor),
+        m_future(std::move(future)),
+        m_fallback(std::move(fallback))
+    {
+    }
+
+    static Future<T> create(Future<T> future, AlarmClock* pClock, Executor* pExecutor,
+            std::chrono::steady_clock::duration timeout, Fallback fallback) {
+        RefPtr<TimeoutTask> pTask = makeRefCounted<TimeoutTask>(pExecutor, future, std::move(fallback));
+        // the timer must be set before attaching to the future, which may be complete already
+        pTask->m_timer.emplace(pClock->setTimerAfter(timeout));
+        pTask->m_timer->getFuture().addSynchronousCallback([pTask]() {
+            onTimer(pTask);
+        });
+        pTask->attachTo(*future.getPromiseFuturePair());
+        return Future<T>(pTask);
+    }
+
+    static void onFutureCompleted(RefPtr<TimeoutTask> pThis) {
+        if(pThis->claim()) {
+            pThis->m_timer->cancel();
+            pThis->setFromOtherFutureMove(pThis->m_future.getPromiseFuturePair());
+        }
+        pThis->m_future.reset();
+    }
+
+private:
+    /** @brief Returns true for the first of the future and the timer to complete*/
+    bool claim() {
+        return !m_isClaimed.exchange(true, std::memory_order_acq_rel);
+    }
+
+    /** @brief Called on the thread of the clock; the fallback, and the continuations of the task, go to the executor*/
+    static void onTimer(RefPtr<TimeoutTask> pThis) {
+        if(pThis->m_timer->getFuture().get() && pThis->claim()) {
+            auto* pRaw = pThis.get();
+            carpal_private::enqueueOrFail(pRaw->m_pExecutor, pRaw, [pThis=std::move(pThis)]() noexcept {
+                pThis->computeAndSet(std::move(pThis->m_fallback));
+            });
+        }
+    }
+
+    Executor* m_pExecutor;
+    Future<T> m_future;
+    Fallback m_fallback;
+    std::optional<Timer> m_timer;
+    std::atomic<bool> m_isClaimed{false};
+};
+
+} // namespace carpal_private
+
+template<typename R, typename Func>
+void carpal_private::TimedActionTask<R, Func>::onFutureCompleted(RefPtr<TimedActionTask> pThis) {
+    bool triggered = pThis->m_timerFuture.get();
+    pThis->m_timerFuture.reset();
+    if(triggered) {
+        auto* pRaw = pThis.get();
+        carpal_private::enqueueOrFail(pRaw->m_pExecutor, pRaw, [pThis=std::move(pThis)]() noexcept {
+            pThis->computeAndSet(std::move(pThis->m_func));
+        });
+    } else if(pThis->isCancellationRequested()) {
+        pThis->setException(std::make_exception_ptr(OperationCanceledException()));
+    } else {
+        pThis->setException(std::make_exception_ptr(TimerCanceledException()));
+    }
+}
+
+/** @brief Returns a future that completes like the given one, or with a @c TimeoutException if the given one does not complete
+ * within the given duration. The timer, set on the given clock, is canceled when the given future completes first; the
+ * exception is set, and the continuations of the returned future are executed, on the given executor.
+ * @note The value is moved from the given future into the returned one.*/
+template<typename T>
+Future<T> withTimeout(Future<T> const& future, AlarmClock* pClock, Executor* pExecutor, std::chrono::steady_clock::duration timeout) {
+    auto fallback = []() -> T {
+        throw TimeoutException();
+    };
+    return carpal_private::TimeoutTask<T, decltype(fallback)>::create(future, pClock, pExecutor, timeout, std::move(fallback));
+}
+
+/** @brief Same as above, using @c alarmClock() and @c defaultExecutor().*/
+template<typename T>
+Future<T> withTimeout(Future<T> const& future, std::chrono::steady_clock::duration timeout) {
+    return withTimeout(future, alarmClock(), defaultExecutor(), timeout);
+}
+
+/** @brief Like @c withTimeout(), but the returned future completes with @c defaultValue on timeout. Not available for
+ * @c Future<void>.*/
+template<typename T>
+Future<T> orDefault(Future<T> const& future, AlarmClock* pClock, Executor* pExecutor, std::chrono::steady_clock::duration timeout,
+        typename PromiseFuturePair<T>::BaseType defaultValue) {
+    auto fallback = [value=std::move(defaultValue)]() mutable -> T {
+        return std::move(value);
+    };
+    return carpal_private::TimeoutTask<T, decltype(fallback)>::create(future, pClock, pExecutor, timeout, std::move(fallback));
+}
+
+/** @brief Same as above, using @c alarmClock() and @c defaultExecutor().*/
+template<typename T>
+Future<T> orDefault(Future<T> const& future, std::chrono::steady_clock::duration timeout,
+        typename PromiseFuturePair<T>::BaseType defaultValue) {
+    return orDefault(future, alarmClock(), defaultExecutor(), timeout, std::move(defaultValue));
+}
+
+template<typename TimePoint, typename Func>
+TimedAction<typename std::invoke_result<Func>::type> AlarmClock::setTimedAction(TimePoint when, Executor* pExecutor, Func func) {
+    using R = typename std::invoke_result<Func>::type;
+    Timer timer = setTimer(when);
+    Future<bool> timerFuture = timer.getFuture();
+    RefPtr<carpal_private::TimedActionTask<R, Func> > pTask = makeRefCounted<carpal_private::TimedActionTask<R, Func> >(
+        pExecutor, std::move(func), timerFuture);
+    pTask->attachTo(*timerFuture.getPromiseFuturePair());
+    return TimedAction<R>(std::move(timer), Future<R>(pTask));
+}
+
 } // namespace carpal
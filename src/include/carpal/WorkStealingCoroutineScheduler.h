@@ -0,0 +1,85 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "CoroutineScheduler.h"
+
+namespace carpal {
+
+namespace carpal_private {
+
+class ThreadExitHook;
+
+} // namespace carpal_private
+
+/** @brief A coroutine scheduler where each thread calling @c schedule() has its own run queue.
+ *
+ * A coroutine marked runnable from such a thread goes to that thread's queue, and is resumed by it in LIFO order; threads
+ * with nothing to run steal the oldest coroutines from the other queues. Coroutines marked runnable from other threads go into
+ * a shared queue.
+ *
+ * Each thread waits on its own condition variable, so making a coroutine runnable wakes a single idle thread, and
+ * @c markThreadRunnable() wakes exactly the given thread.
+ *
+ * @note At most @c maxStealableThreads threads get a queue that others can steal from; further threads use the shared queue.
+ * When a thread exits, its queue is handed over to the next thread starting to use the scheduler.
+ * */
+class WorkStealingCoroutineScheduler : public AbstractCoroutineScheduler {
+public:
+    explicit WorkStealingCoroutineScheduler(unsigned maxStealableThreads = 256);
+    ~WorkStealingCoroutineScheduler() override;
+
+    void markRunnable(std::coroutine_handle<void> h) override;
+    void markThreadRunnable(std::thread::id tid) override;
+    std::coroutine_handle<void> schedule() override;
+
+private:
+    class Participant;
+
+    /** @brief Returns the participant for the current thread, creating it if needed*/
+    Participant& currentParticipant();
+    /** @brief Returns the participant for the given thread, creating it, or reusing one left by an exited thread, if needed*/
+    Participant& participantFor(std::thread::id tid);
+    /** @brief Called when the given thread exits; makes its participant available for reuse*/
+    void releaseParticipant(std::thread::id tid);
+
+    void* findTask(Participant& self);
+    bool hasVisibleTasks() const;
+    void wakeOne();
+    /** @brief Removes the participant from the idle list, if still there*/
+    void leaveIdle(Participant& self);
+
+    /** @brief Identifies the scheduler in the thread-local cache of the current participant*/
+    uint64_t const m_id;
+    unsigned const m_maxStealableThreads;
+
+    std::mutex m_mtx;
+    /** @brief All the participants; they are never destroyed before the scheduler, since other threads may refer to them*/
+    std::vector<std::unique_ptr<Participant> > m_allParticipants;
+    std::unordered_map<std::thread::id, Participant*> m_participants;
+    /** @brief The participants of the threads that exited*/
+    std::vector<Participant*> m_freeParticipants;
+    std::unique_ptr<std::atomic<Participant*>[]> m_stealable;
+    std::atomic<unsigned> m_nrStealable{0};
+    std::vector<Participant*> m_idle;
+    std::atomic<unsigned> m_nrIdle{0};
+    std::deque<void*> m_injected;
+    std::atomic<size_t> m_nrInjected{0};
+    /** @brief Reaches the scheduler, if still alive, from the exiting threads*/
+    std::shared_ptr<carpal_private::ThreadExitHook> m_pExitHook;
+};
+
+} // namespace carpal
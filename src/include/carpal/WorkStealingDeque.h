@@ -0,0 +1,138 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace carpal {
+
+/** @brief A Chase-Lev work-stealing deque.
+ *
+ * A single thread (the owner) calls @c push() and @c pop(), which work at the bottom end of the deque (LIFO).
+ * Any number of other threads can call @c steal(), which takes elements from the top end (FIFO).
+ *
+ * @c T must be trivially copyable and small enough for @c std::atomic<T> to be lock-free; typically, it is a pointer.
+ * An empty result is signalled by returning a value-initialized @c T (e.g. @c nullptr).
+ *
+ * @note The buffer grows as needed. Old buffers are kept until the deque is destroyed, because a thief may still be
+ * reading from them.
+ * */
+template<typename T>
+class WorkStealingDeque {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "WorkStealingDeque elements must be trivially copyable");
+
+    explicit WorkStealingDeque(std::int64_t initialCapacity = 256) {
+        std::int64_t capacity = 1;
+        while(capacity < initialCapacity) capacity *= 2;
+        m_buffers.push_back(std::make_unique<Buffer>(capacity));
+        m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(WorkStealingDeque const&) = delete;
+    WorkStealingDeque& operator=(WorkStealingDeque const&) = delete;
+
+    /** @brief Adds an element at the bottom. Must be called only by the owner thread.*/
+    void push(T val) {
+        std::int64_t b = m_bottom.load(std::memory_order_relaxed);
+        std::int64_t t = m_top.load(std::memory_order_acquire);
+        Buffer* pBuffer = m_buffer.load(std::memory_order_relaxed);
+        if(b - t > pBuffer->capacity() - 1) {
+            pBuffer = grow(pBuffer, b, t);
+        }
+        pBuffer->put(b, val);
+        m_bottom.store(b + 1, std::memory_order_release);
+    }
+
+    /** @brief Removes the most recently pushed element. Must be called only by the owner thread.
+     * @return The element, or a value-initialized @c T if the deque is empty.*/
+    T pop() {
+        std::int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* pBuffer = m_buffer.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = m_top.load(std::memory_order_relaxed);
+        if(t > b) {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return T{};
+        }
+        T ret = pBuffer->get(b);
+        if(t == b) {
+            // last element; race against thieves
+            if(!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                ret = T{};
+            }
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    /** @brief Removes the oldest element. Can be called from any thread.
+     * @return The element, or a value-initialized @c T if the deque is empty or if another thread won the race for it.*/
+    T steal() {
+        std::int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t b = m_bottom.load(std::memory_order_acquire);
+        if(t >= b) {
+            return T{};
+        }
+        Buffer* pBuffer = m_buffer.load(std::memory_order_acquire);
+        T ret = pBuffer->get(t);
+        if(!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return T{};
+        }
+        return ret;
+    }
+
+    /** @brief Returns true if the deque appears empty. Can be called from any thread.
+     * @note the result can be outdated by the time the caller can use the result.*/
+    bool empty() const noexcept {
+        std::int64_t t = m_top.load(std::memory_order_acquire);
+        std::int64_t b = m_bottom.load(std::memory_order_acquire);
+        return t >= b;
+    }
+
+private:
+    class Buffer {
+    public:
+        explicit Buffer(std::int64_t capacity)
+            :m_mask(capacity - 1),
+            m_items(new std::atomic<T>[capacity])
+        {}
+        std::int64_t capacity() const noexcept {
+            return m_mask + 1;
+        }
+        T get(std::int64_t index) const noexcept {
+            return m_items[index & m_mask].load(std::memory_order_relaxed);
+        }
+        void put(std::int64_t index, T val) noexcept {
+            m_items[index & m_mask].store(val, std::memory_order_relaxed);
+        }
+    private:
+        std::int64_t m_mask;
+        std::unique_ptr<std::atomic<T>[]> m_items;
+    };
+
+    Buffer* grow(Buffer* pOld, std::int64_t b, std::int64_t t) {
+        m_buffers.push_back(std::make_unique<Buffer>(pOld->capacity() * 2));
+        Buffer* pNew = m_buffers.back().get();
+        for(std::int64_t i = t ; i < b ; ++i) {
+            pNew->put(i, pOld->get(i));
+        }
+        m_buffer.store(pNew, std::memory_order_release);
+        return pNew;
+    }
+
+    std::atomic<std::int64_t> m_top{0};
+    std::atomic<std::int64_t> m_bottom{0};
+    std::atomic<Buffer*> m_buffer{nullptr};
+    std::vector<std::unique_ptr<Buffer> > m_buffers; // owner only; keeps retired buffers alive
+};
+
+} // namespace carpal
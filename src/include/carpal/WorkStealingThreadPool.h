@@ -0,0 +1,56 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Executor.h"
+
+namespace carpal {
+
+/** @brief A thread pool where each worker thread has its own task deque.
+ *
+ * Tasks enqueued from a worker thread go to the bottom of that worker's deque and are executed by it in LIFO order,
+ * so continuations tend to run on the thread (and cache) that produced their input. Idle workers steal from the top
+ * (oldest end) of other workers' deques. Tasks enqueued from threads outside the pool go into a shared queue.
+ *
+ * @note The deques hold pointers to tasks; each worker recycles those boxes, so that in steady state enqueueing from
+ * a worker thread does not allocate memory.
+ * */
+class WorkStealingThreadPool : public Executor {
+public:
+    explicit WorkStealingThreadPool(unsigned nrThreads);
+    ~WorkStealingThreadPool() override;
+    void enqueue(Runnable func) override;
+
+    void close();
+
+private:
+    class Worker;
+
+    void threadFunction(unsigned index);
+    bool findTask(unsigned index, Runnable& task);
+    bool hasVisibleTasks() const;
+    void wakeOne();
+
+    std::vector<std::unique_ptr<Worker> > m_workers;
+
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::deque<Runnable> m_injectedTasks;
+    std::atomic<size_t> m_nrInjectedTasks{0};
+    std::atomic<unsigned> m_nrSleepingThreads{0};
+    bool m_isClosed = false;
+
+    std::vector<std::thread> m_threads;
+};
+
+} // namespace carpal
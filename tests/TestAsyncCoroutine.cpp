@@ -3,8 +3,11 @@
 // (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
 
 #include "carpal/AsyncCoroutine.h"
+#include "carpal/ExecutorCoroutineScheduler.h"
 #include "carpal/Future.h"
+#include "carpal/MemoryResource.h"
 #include "carpal/ThreadPool.h"
+#include "carpal/WorkStealingCoroutineScheduler.h"
 
 #include <catch2/catch.hpp>
 #include <stdio.h>
@@ -13,11 +16,11 @@
 
 using namespace carpal;
 
-carpal::AsyncCoroutine<int> coroFunc(carpal::CoroutineScheduler*, int const& v) {
+carpal::AsyncCoroutine<int> coroFunc(carpal::AbstractCoroutineScheduler*, int const& v) {
     co_return v + 1;
 };
 
-carpal::AsyncCoroutine<int> coroFunc_future(carpal::CoroutineScheduler*, Future<int> f) {
+carpal::AsyncCoroutine<int> coroFunc_future(carpal::AbstractCoroutineScheduler*, Future<int> f) {
     int ret = (co_await f) + 1;
     co_return ret;
 };
@@ -128,3 +131,173 @@ TEST_CASE("SimpleCoroutine_layers_multithread2", "[asyncCoroutine]") {
         child.join();
     }
 }
+
+TEST_CASE("WorkStealingCoroutineScheduler_simple", "[asyncCoroutine]") {
+    WorkStealingCoroutineScheduler scheduler;
+    Promise<int> p;
+    auto fx = executeLaterVoid([p](){
+        p.set(20);
+    }, 30);
+    auto coro = coroFunc_future(&scheduler, p.future());
+    CHECK(coro.get() == 21);
+    CHECK(coroFunc(&scheduler, 10).get() == 11);
+}
+
+TEST_CASE("WorkStealingCoroutineScheduler_multithread", "[asyncCoroutine]") {
+    WorkStealingCoroutineScheduler scheduler;
+    ThreadPool tp(2);
+    constexpr int nrThreads = 4;
+    constexpr int nrCoroutines = 50;
+    std::atomic<int> nrCorrect{0};
+    std::vector<std::thread> threads;
+    for(int t=0 ; t<nrThreads ; ++t) {
+        threads.emplace_back([&scheduler, &tp, &nrCorrect, t]() {
+            for(int i=0 ; i<nrCoroutines ; ++i) {
+                Future<int> f = runAsync(&tp, [t, i]() { return t * 1000 + i; });
+                auto coro = coroFunc_future(&scheduler, f);
+                if(coro.get() == t * 1000 + i + 1) {
+                    ++nrCorrect;
+                }
+            }
+        });
+    }
+    for(auto& th : threads) {
+        th.join();
+    }
+    CHECK(nrCorrect == nrThreads * nrCoroutines);
+}
+
+TEST_CASE("WorkStealingCoroutineScheduler_short_lived_threads", "[asyncCoroutine]") {
+    // each thread takes over the queue left by the previous one
+    WorkStealingCoroutineScheduler scheduler(1);
+    ThreadPool tp(2);
+    constexpr int nrThreads = 20;
+    std::atomic<int> nrCorrect{0};
+    for(int t=0 ; t<nrThreads ; ++t) {
+        std::thread th([&scheduler, &tp, &nrCorrect, t]() {
+            Future<int> f = runAsync(&tp, [t]() { return t; });
+            if(coroFunc_future(&scheduler, f).get() == t + 1) {
+                ++nrCorrect;
+            }
+        });
+        th.join();
+    }
+    CHECK(nrCorrect == nrThreads);
+}
+
+TEST_CASE("ExecutorCoroutineScheduler_get", "[asyncCoroutine]") {
+    ThreadPool tp(4);
+    ExecutorCoroutineScheduler scheduler(&tp);
+    std::vector<AsyncCoroutine<int> > coros;
+    for(int i=0 ; i<20 ; ++i) {
+        coros.push_back(coroFunc_future(&scheduler, runAsync(&tp, [i]() { return i; })));
+    }
+    bool allCorrect = true;
+    for(int i=0 ; i<20 ; ++i) {
+        allCorrect = allCorrect && (coros[i].get() == i + 1);
+    }
+    CHECK(allCorrect);
+}
+
+carpal::AsyncCoroutine<int> coroFunc_fireAndForget(carpal::AbstractCoroutineScheduler*, Future<int> f, Promise<int> done) {
+    int v = co_await f;
+    done.set(v + 1);
+    co_return v;
+};
+
+TEST_CASE("ExecutorCoroutineScheduler_fire_and_forget", "[asyncCoroutine]") {
+    ThreadPool tp(2);
+    ExecutorCoroutineScheduler scheduler(&tp);
+    Promise<int> p;
+    Promise<int> done;
+    Future<int> doneFuture = done.future();
+    {
+        // the coroutine outlives the AsyncCoroutine object
+        AsyncCoroutine<int> coro = coroFunc_fireAndForget(&scheduler, p.future(), done);
+    }
+    p.set(5);
+    CHECK(doneFuture.get() == 6);
+}
+
+carpal::AsyncCoroutine<int> coroFunc_nested(carpal::AbstractCoroutineScheduler* pScheduler, Future<int> f) {
+    AsyncCoroutine<int> inner = coroFunc_future(pScheduler, f);
+    int v = co_await inner;
+    co_return v * 2;
+};
+
+TEST_CASE("ExecutorCoroutineScheduler_nested", "[asyncCoroutine]") {
+    ThreadPool tp(2);
+    ExecutorCoroutineScheduler scheduler(&tp);
+    Promise<int> p;
+    auto coro = coroFunc_nested(&scheduler, p.future());
+    auto fx = executeLaterVoid([p](){
+        p.set(20);
+    }, 30);
+    CHECK(coro.get() == 42);
+}
+
+namespace {
+
+class RejectingExecutor : public Executor {
+public:
+    void enqueue(Runnable) override {
+        throw ExecutorRejectedException();
+    }
+    bool tryEnqueue(Runnable&) override {
+        return false;
+    }
+};
+
+} // namespace
+
+TEST_CASE("ExecutorCoroutineScheduler_rejected", "[asyncCoroutine]") {
+    // a coroutine refused by the executor is resumed on the thread completing the future
+    RejectingExecutor executor;
+    ExecutorCoroutineScheduler scheduler(&executor);
+    Promise<int> p;
+    auto coro = coroFunc_future(&scheduler, p.future());
+    auto fx = executeLaterVoid([p](){
+        p.set(20);
+    }, 30);
+    CHECK(coro.get() == 21);
+}
+
+// GCC 12 false positive; see the note on CoroutineFrameAllocator::operator new()
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+carpal::AsyncCoroutine<int> coroFunc_allocator(std::allocator_arg_t, std::pmr::memory_resource*, carpal::CoroutineScheduler*, Future<int> f) {
+    int ret = (co_await f) + 1;
+    co_return ret;
+};
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+TEST_CASE("AsyncCoroutine_allocator_arg", "[asyncCoroutine]") {
+    CountingResource resource;
+    CoroutineScheduler scheduler;
+    Promise<int> p;
+    {
+        auto coro = coroFunc_allocator(std::allocator_arg, &resource, &scheduler, p.future());
+        CHECK(resource.nrAllocations == 1);
+        auto fx = executeLaterVoid([p](){
+            p.set(20);
+        }, 30);
+        CHECK(coro.get() == 21);
+    }
+    CHECK(resource.nrDeallocations == 1);
+}
+
+TEST_CASE("AsyncCoroutine_current_memory_resource", "[asyncCoroutine]") {
+    CountingResource resource;
+    CoroutineScheduler scheduler;
+    {
+        MemoryResourceScope scope(&resource);
+        auto coro = coroFunc(&scheduler, 10);
+        CHECK(resource.nrAllocations == 1);
+        CHECK(coro.get() == 11);
+    }
+    CHECK(resource.nrDeallocations == 1);
+}
@@ -0,0 +1,261 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/Cancellation.h"
+#include "carpal/Future.h"
+#include "carpal/MemoryResource.h"
+#include "carpal/ThreadPool.h"
+#include "carpal/Timer.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <optional>
+#include <thread>
+
+#include "TestHelper.h"
+
+using namespace carpal;
+
+namespace {
+
+bool isCanceled(PromiseFuturePairBase& future) {
+    try {
+        std::rethrow_exception(future.getException());
+    } catch(OperationCanceledException&) {
+        return true;
+    } catch(...) {
+    }
+    return false;
+}
+
+template<typename T>
+bool isCanceled(Future<T> const& future) {
+    return isCanceled(*future.getPromiseFuturePair());
+}
+
+} // namespace
+
+TEST_CASE("Cancellation_token", "[cancellation]") {
+    CancellationToken none;
+    CHECK(!none.canBeCanceled());
+    CHECK(!none.isCancellationRequested());
+    CancellationSource source;
+    CancellationToken token = source.token();
+    CHECK(token.canBeCanceled());
+    CHECK(!token.isCancellationRequested());
+    source.cancel();
+    CHECK(token.isCancellationRequested());
+    CHECK(source.isCancellationRequested());
+    source.cancel();
+    CHECK(token.isCancellationRequested());
+}
+
+TEST_CASE("Cancellation_scope", "[cancellation]") {
+    CancellationSource source;
+    CHECK(!currentCancellationToken().canBeCanceled());
+    {
+        CancellationScope scope(source.token());
+        CHECK(currentCancellationToken().canBeCanceled());
+        {
+            CancellationScope inner{CancellationToken()};
+            CHECK(!currentCancellationToken().canBeCanceled());
+        }
+        CHECK(currentCancellationToken().canBeCanceled());
+    }
+    CHECK(!currentCancellationToken().canBeCanceled());
+}
+
+TEST_CASE("Cancellation_chain_not_executed", "[cancellation]") {
+    ThreadPool tp(2);
+    CancellationSource source;
+    Promise<int> p;
+    std::atomic_int nrExecuted{0};
+    std::optional<Future<int> > f1;
+    std::optional<Future<void> > f2;
+    {
+        CancellationScope scope(source.token());
+        f1.emplace(p.future().then(&tp, [&nrExecuted](int v) {
+            ++nrExecuted;
+            return v + 1;
+        }));
+        f2.emplace(f1->then(&tp, [&nrExecuted](int) {
+            ++nrExecuted;
+        }));
+    }
+    source.cancel();
+    p.set(1);
+    CHECK_THROWS_AS(f1->get(), OperationCanceledException);
+    CHECK(isCanceled(*f2));
+    CHECK(nrExecuted == 0);
+}
+
+TEST_CASE("Cancellation_not_canceled", "[cancellation]") {
+    ThreadPool tp(2);
+    CancellationSource source;
+    std::optional<Future<int> > f;
+    {
+        CancellationScope scope(source.token());
+        f.emplace(completeLater(10).then(&tp, [](int v) {return v + 1;}));
+    }
+    CHECK(f->get() == 11);
+    source.cancel();
+    CHECK(f->get() == 11);
+}
+
+TEST_CASE("Cancellation_propagates_to_inner_chains", "[cancellation]") {
+    ThreadPool tp(2);
+    CancellationSource source;
+    Promise<int> p;
+    std::atomic_bool isInnerExecuted{false};
+    std::atomic_bool isTokenSeen{false};
+    std::optional<Future<int> > f;
+    {
+        CancellationScope scope(source.token());
+        f.emplace(runAsync(&tp, []() {return 1;}).thenAsync(&tp, [&](int) {
+            isTokenSeen = currentCancellationToken().canBeCanceled();
+            // created without an explicit scope, on a thread pool thread
+            return p.future().then(&tp, [&isInnerExecuted](int v) {
+                isInnerExecuted = true;
+                return v;
+            });
+        }));
+    }
+    delay(20);
+    CHECK(isTokenSeen);
+    CHECK(!f->isComplete());
+    source.cancel();
+    p.set(5);
+    CHECK_THROWS_AS(f->get(), OperationCanceledException);
+    CHECK(!isInnerExecuted);
+}
+
+TEST_CASE("Cancellation_async_loop", "[cancellation]") {
+    ThreadPool tp(2);
+    CancellationSource source;
+    std::atomic_int nrIterations{0};
+    std::optional<Future<int> > f;
+    {
+        CancellationScope scope(source.token());
+        f.emplace(completedFuture(0).thenAsyncLoop(&tp, [](int) {return true;}, [&nrIterations](int v) {
+            ++nrIterations;
+            return completeLater(v + 1, 1);
+        }));
+    }
+    delay(20);
+    source.cancel();
+    CHECK_THROWS_AS(f->get(), OperationCanceledException);
+    int nrIterationsAtEnd = nrIterations;
+    CHECK(nrIterationsAtEnd > 0);
+    delay(20);
+    CHECK(nrIterations == nrIterationsAtEnd);
+}
+
+TEST_CASE("Cancellation_timer", "[cancellation][timer]") {
+    CancellationSource source;
+    std::atomic_bool isExecuted{false};
+    std::optional<Timer> timer;
+    std::optional<TimedAction<void> > action;
+    {
+        CancellationScope scope(source.token());
+        timer.emplace(alarmClock()->setTimerAfter(std::chrono::hours(1)));
+        action.emplace(alarmClock()->setTimedActionAfter(std::chrono::hours(1), [&isExecuted]() {isExecuted = true;}));
+    }
+    CHECK(!timer->getFuture().isComplete());
+    source.cancel();
+    CHECK(timer->getFuture().isComplete());
+    CHECK(!timer->getFuture().get());
+    CHECK(isCanceled(action->getFuture()));
+    CHECK(!isExecuted);
+}
+
+TEST_CASE("Cancellation_timer_already_canceled", "[cancellation][timer]") {
+    CancellationSource source;
+    source.cancel();
+    CancellationScope scope(source.token());
+    Timer timer = alarmClock()->setTimerAfter(std::chrono::hours(1));
+    CHECK(timer.getFuture().isComplete());
+    CHECK(!timer.getFuture().get());
+}
+
+TEST_CASE("Cancellation_timer_fires", "[cancellation][timer]") {
+    CancellationSource source;
+    std::optional<Future<bool> > f;
+    {
+        CancellationScope scope(source.token());
+        f.emplace(alarmClock()->setTimerAfter(std::chrono::milliseconds(5)).getFuture());
+    }
+    CHECK(f->get());
+    source.cancel();
+    CHECK(f->get());
+}
+
+TEST_CASE("Cancellation_timer_clock_destroyed", "[cancellation][timer]") {
+    // The first timer's cancellation runs its continuation, which destroys, on another thread, the clock of the second
+    // timer; the second timer's cancellation callback must then not be executed on the destroyed clock.
+    CancellationSource source;
+    std::optional<AlarmClock> clock;
+    clock.emplace();
+    std::optional<Future<bool> > f1;
+    std::optional<Future<bool> > f2;
+    {
+        CancellationScope scope(source.token());
+        f1.emplace(alarmClock()->setTimerAfter(std::chrono::hours(1)).getFuture());
+        f2.emplace(clock->setTimerAfter(std::chrono::hours(1)).getFuture());
+    }
+    f1->getPromiseFuturePair()->addSynchronousCallback([&clock]() {
+        std::thread destroyer([&clock]() {
+            clock.reset();
+        });
+        destroyer.join();
+    });
+    source.cancel();
+    CHECK(!clock.has_value());
+    CHECK(!f1->get());
+    CHECK(!f2->get());
+}
+
+TEST_CASE("Cancellation_timer_clock_destroyed_concurrently", "[cancellation][timer]") {
+    for(int i=0 ; i<200 ; ++i) {
+        CancellationSource source;
+        std::optional<AlarmClock> clock;
+        clock.emplace();
+        std::optional<Future<bool> > f;
+        {
+            CancellationScope scope(source.token());
+            f.emplace(clock->setTimerAfter(std::chrono::hours(1)).getFuture());
+        }
+        std::thread destroyer([&clock]() {
+            clock.reset();
+        });
+        source.cancel();
+        destroyer.join();
+        CHECK(!f->get());
+    }
+}
+
+TEST_CASE("Cancellation_timer_set_concurrently", "[cancellation][timer]") {
+    // a timer canceled while being set must neither race on its state nor be left in the clock
+    CountingResource resource;
+    AlarmClock clock;
+    for(int i=0 ; i<200 ; ++i) {
+        CancellationSource source;
+        std::optional<Future<bool> > f;
+        std::atomic_bool isStarted{false};
+        std::thread setter([&]() {
+            MemoryResourceScope memoryScope(&resource);
+            CancellationScope scope(source.token());
+            isStarted = true;
+            f.emplace(clock.setTimerAfter(std::chrono::hours(1)).getFuture());
+        });
+        while(!isStarted) {
+            std::this_thread::yield();
+        }
+        source.cancel();
+        setter.join();
+        CHECK(!f->get());
+    }
+    // all the timers are freed, so none of them is still held by the clock
+    CHECK(resource.nrAllocations == resource.nrDeallocations);
+}
@@ -0,0 +1,278 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/Future.h"
+#include "carpal/InlineExecutor.h"
+#include "carpal/Runnable.h"
+#include "carpal/ThreadPool.h"
+#include "carpal/WorkStealingDeque.h"
+#include "carpal/WorkStealingThreadPool.h"
+
+#include <catch2/catch.hpp>
+#include <stdio.h>
+
+#include "TestHelper.h"
+
+using namespace carpal;
+
+TEST_CASE("Runnable_inline", "[executor]") {
+    int val = 0;
+    std::shared_ptr<int> p = std::make_shared<int>(5);
+    auto func = [&val, p]() { val += *p; };
+    CHECK(Runnable::isStoredInline<decltype(func)>());
+    Runnable r(std::move(func));
+    CHECK(r != nullptr);
+    Runnable r2 = std::move(r);
+    CHECK(r == nullptr);
+    r2();
+    CHECK(val == 5);
+    CHECK(p.use_count() == 2);
+    r2.reset();
+    CHECK(p.use_count() == 1);
+}
+
+TEST_CASE("Runnable_heap", "[executor]") {
+    char big[2 * Runnable::inlineSize] = {};
+    big[0] = 7;
+    int val = 0;
+    auto func = [&val, big]() { val = big[0]; };
+    CHECK(!Runnable::isStoredInline<decltype(func)>());
+    Runnable r(func);
+    Runnable r2;
+    r2 = std::move(r);
+    CHECK(!r);
+    r2();
+    CHECK(val == 7);
+}
+
+TEST_CASE("Runnable_move_only", "[executor]") {
+    ThreadPool tp(2);
+    NonCopyableInt v(42);
+    Promise<int> p;
+    tp.enqueue([p, v=std::move(v)]() {
+        p.set(v.val());
+    });
+    CHECK(p.future().get() == 42);
+}
+
+TEST_CASE("WorkStealingDeque_single_thread", "[executor]") {
+    WorkStealingDeque<int*> deque(2);
+    int vals[10];
+    CHECK(deque.empty());
+    CHECK(deque.pop() == nullptr);
+    for(int i=0 ; i<10 ; ++i) {
+        deque.push(&vals[i]);
+    }
+    CHECK(!deque.empty());
+    CHECK(deque.steal() == &vals[0]);
+    CHECK(deque.pop() == &vals[9]);
+    CHECK(deque.steal() == &vals[1]);
+    for(int i=8 ; i>=2 ; --i) {
+        CHECK(deque.pop() == &vals[i]);
+    }
+    CHECK(deque.pop() == nullptr);
+    CHECK(deque.steal() == nullptr);
+}
+
+TEST_CASE("WorkStealingDeque_concurrent_steal", "[executor]") {
+    constexpr int nrItems = 100000;
+    constexpr int nrThieves = 4;
+    std::vector<int> items(nrItems, 0);
+    std::vector<std::atomic_int> taken(nrItems);
+    WorkStealingDeque<int*> deque;
+    std::atomic_bool done(false);
+
+    std::vector<std::thread> thieves;
+    for(int t=0 ; t<nrThieves ; ++t) {
+        thieves.emplace_back([&](){
+            while(!done.load() || !deque.empty()) {
+                int* p = deque.steal();
+                if(p != nullptr) taken[p - items.data()].fetch_add(1);
+            }
+        });
+    }
+    for(int i=0 ; i<nrItems ; ++i) {
+        deque.push(&items[i]);
+        if(i % 3 == 0) {
+            int* p = deque.pop();
+            if(p != nullptr) taken[p - items.data()].fetch_add(1);
+        }
+    }
+    done.store(true);
+    for(auto& t : thieves) t.join();
+    int* p;
+    while((p = deque.pop()) != nullptr) taken[p - items.data()].fetch_add(1);
+
+    bool allOnce = true;
+    for(auto& t : taken) {
+        if(t.load() != 1) allOnce = false;
+    }
+    CHECK(allOnce);
+}
+
+TEST_CASE("WorkStealingThreadPool_simple", "[executor]") {
+    WorkStealingThreadPool tp(4);
+    Future<int> f = runAsync(&tp, [](){
+        delay(10);
+        return 42;
+    });
+    CHECK(42 == f.get());
+}
+
+TEST_CASE("WorkStealingThreadPool_fan_out", "[executor]") {
+    WorkStealingThreadPool tp(4);
+    std::atomic_int count(0);
+    Promise<void> done;
+    constexpr int nrTasks = 10000;
+    tp.enqueue([&](){
+        for(int i=0 ; i<nrTasks ; ++i) {
+            tp.enqueue([&](){
+                if(count.fetch_add(1) + 1 == nrTasks) done.set();
+            });
+        }
+    });
+    done.future().wait();
+    CHECK(count.load() == nrTasks);
+}
+
+TEST_CASE("WorkStealingThreadPool_continuations", "[executor]") {
+    WorkStealingThreadPool tp(4);
+    Promise<int> pf;
+    Future<int> f2 = pf.future()
+        .then(&tp, [](int a)->int {return a + 1; })
+        .then(&tp, [](int a)->int {return a * 2; });
+    pf.set(10);
+    CHECK(22 == f2.get());
+}
+
+TEST_CASE("InlineExecutor_runs_on_completing_thread", "[executor]") {
+    ThreadPool tp(2);
+    Promise<int> p;
+    std::thread::id contThread;
+    Future<int> f = p.future().thenInline([&contThread](int a) {
+        contThread = std::this_thread::get_id();
+        return a + 1;
+    });
+    std::thread::id producerThread;
+    tp.enqueue([p, &producerThread]() {
+        producerThread = std::this_thread::get_id();
+        p.set(5);
+    });
+    CHECK(f.get() == 6);
+    CHECK(contThread == producerThread);
+
+    std::thread::id completedThread;
+    completedFuture().thenInline([&completedThread]() { completedThread = std::this_thread::get_id(); }).wait();
+    CHECK(completedThread == std::this_thread::get_id());
+}
+
+TEST_CASE("InlineExecutor_depth_guard", "[executor]") {
+    ThreadPool fallback(1);
+    InlineExecutor executor(&fallback, 8);
+    constexpr int chainLength = 10000;
+    Promise<int> p;
+    Future<int> f = p.future();
+    for(int i=0 ; i<chainLength ; ++i) {
+        f = f.then(&executor, [](int a) { return a + 1; });
+    }
+    p.set(0);
+    CHECK(f.get() == chainLength);
+}
+
+namespace {
+
+/** @brief Occupies the single thread of the pool until the returned promise is set*/
+Promise<void> blockPool(ThreadPool& tp) {
+    Promise<void> gate;
+    Promise<void> started;
+    tp.enqueue([gate, started]() {
+        started.set();
+        gate.future().wait();
+    });
+    started.future().wait();
+    return gate;
+}
+
+} // namespace
+
+TEST_CASE("ThreadPool_bounded_reject", "[executor]") {
+    ThreadPool tp(1, 2, ThreadPool::OverflowPolicy::reject);
+    Promise<void> gate = blockPool(tp);
+    Future<int> f1 = runAsync(&tp, []() { return 1; });
+    Future<int> f2 = runAsync(&tp, []() { return 2; });
+    Future<int> f3 = runAsync(&tp, []() { return 3; });
+    CHECK(f3.isException());
+    CHECK_THROWS_AS(f3.get(), ExecutorRejectedException);
+    CHECK_THROWS_AS(tp.enqueue([]() {}), ExecutorRejectedException);
+    Future<int> f4 = completedFuture(4).then(&tp, [](int v) { return v; });
+    CHECK_THROWS_AS(f4.get(), ExecutorRejectedException);
+    gate.set();
+    CHECK(f1.get() == 1);
+    CHECK(f2.get() == 2);
+    // there is room again
+    CHECK(runAsync(&tp, []() { return 5; }).get() == 5);
+}
+
+TEST_CASE("ThreadPool_bounded_run_in_caller", "[executor]") {
+    ThreadPool tp(1, 1, ThreadPool::OverflowPolicy::runInCaller);
+    Promise<void> gate = blockPool(tp);
+    Future<std::thread::id> f1 = runAsync(&tp, []() { return std::this_thread::get_id(); });
+    Future<std::thread::id> f2 = runAsync(&tp, []() { return std::this_thread::get_id(); });
+    CHECK(f2.isComplete());
+    CHECK(f2.get() == std::this_thread::get_id());
+    gate.set();
+    CHECK(f1.get() != std::this_thread::get_id());
+}
+
+TEST_CASE("ThreadPool_bounded_block", "[executor]") {
+    ThreadPool tp(1, 1, ThreadPool::OverflowPolicy::block);
+    Promise<void> gate = blockPool(tp);
+    Future<int> f1 = runAsync(&tp, []() { return 1; });
+    std::atomic_bool enqueued(false);
+    std::thread producer([&tp, &enqueued]() {
+        tp.enqueue([]() {});
+        enqueued.store(true);
+    });
+    delay(50);
+    CHECK(!enqueued.load());
+    gate.set();
+    producer.join();
+    CHECK(enqueued.load());
+    CHECK(f1.get() == 1);
+}
+
+TEST_CASE("ThreadPool_bounded_block_closed", "[executor]") {
+    ThreadPool tp(1, 1, ThreadPool::OverflowPolicy::block);
+    Promise<void> gate = blockPool(tp);
+    Future<int> f1 = runAsync(&tp, []() { return 1; });
+    std::atomic_int result(-1);
+    std::thread producer([&tp, &result]() {
+        Runnable task([]() {});
+        result.store(tp.tryEnqueue(task) ? 1 : 0);
+    });
+    delay(50);
+    CHECK(result.load() == -1);
+    tp.close();
+    producer.join();
+    CHECK(result.load() == 0);
+    gate.set();
+    CHECK(f1.get() == 1);
+}
+
+TEST_CASE("ThreadPool_bounded_internal_tasks_accepted", "[executor]") {
+    ThreadPool tp(1, 1, ThreadPool::OverflowPolicy::reject);
+    // a chain of continuations on the pool's own thread must not be rejected, even if it exceeds the capacity
+    Future<Future<int> > f = runAsync(&tp, [&tp]() {
+        std::vector<Future<int> > futures;
+        for(int i=0 ; i<10 ; ++i) {
+            futures.push_back(runAsync(&tp, [i]() { return i; }));
+        }
+        return whenAllFromArrayOfFutures(&tp, [](std::vector<Future<int> > results) {
+            int s = 0;
+            for(auto& r : results) s += r.get();
+            return s;
+        }, std::move(futures));
+    });
+    CHECK(f.get().get() == 45);
+}
@@ -62,6 +62,86 @@ TEST_CASE("Future_not_completed", "[future]") {
     CHECK(cont == 11);
 }
 
+TEST_CASE("Future_one_pointer_wide", "[future]") {
+    CHECK(sizeof(Future<int>) == sizeof(void*));
+    CHECK(sizeof(Promise<int>) == sizeof(void*));
+    std::shared_ptr<int> pVal = std::make_shared<int>(7);
+    {
+        // declared first, so that its threads are joined after the futures are dropped
+        ThreadPool tp(2);
+        Promise<std::shared_ptr<int> > p;
+        Future<int> f = p.future()
+            .then(&tp, [](std::shared_ptr<int> v) { return *v; })
+            .then(&tp, [](int v) { return v + 1; });
+        p.set(pVal);
+        CHECK(f.get() == 8);
+    }
+    // all shared states, and the value held by the first one, have been released
+    CHECK(pVal.use_count() == 1);
+}
+
+TEST_CASE("Future_many_callbacks_in_order", "[future]") {
+    Promise<int> p;
+    Future<int> f = p.future();
+    std::vector<int> order;
+    for(int i=0 ; i<10000 ; ++i) {
+        f.addSynchronousCallback([&order, i]() {order.push_back(i);});
+    }
+    CHECK(order.empty());
+    p.set(1);
+    bool inOrder = order.size() == 10000;
+    for(int i=0 ; inOrder && i<10000 ; ++i) {
+        inOrder = (order[i] == i);
+    }
+    CHECK(inOrder);
+}
+
+TEST_CASE("Future_callbacks_concurrent_with_completion", "[future]") {
+    for(int iteration = 0 ; iteration < 20 ; ++iteration) {
+        Promise<int> p;
+        Future<int> f = p.future();
+        std::atomic_int count(0);
+        std::vector<std::thread> threads;
+        for(int t=0 ; t<4 ; ++t) {
+            threads.emplace_back([f, &count]() {
+                for(int i=0 ; i<1000 ; ++i) {
+                    f.addSynchronousCallback([&count]() {count.fetch_add(1);});
+                }
+            });
+        }
+        p.set(1);
+        for(auto& t : threads) t.join();
+        CHECK(count.load() == 4000);
+    }
+}
+
+TEST_CASE("Future_callbacks_never_completed", "[future]") {
+    std::shared_ptr<int> p = std::make_shared<int>(1);
+    {
+        Promise<int> promise;
+        promise.future().addSynchronousCallback([p]() {});
+        CHECK(p.use_count() == 2);
+    }
+    CHECK(p.use_count() == 1);
+}
+
+TEST_CASE("Future_wait_many_threads", "[future]") {
+    Promise<int> p;
+    Future<int> f = p.future();
+    std::atomic_int sum(0);
+    std::vector<std::thread> threads;
+    for(int t=0 ; t<8 ; ++t) {
+        threads.emplace_back([f, &sum]() {
+            sum.fetch_add(f.get());
+        });
+    }
+    delay(10);
+    CHECK(sum.load() == 0);
+    p.set(3);
+    for(auto& t : threads) t.join();
+    CHECK(sum.load() == 24);
+}
+
 TEST_CASE("ThreadPool_simple", "[futures]") {
     ThreadPool tp(32);
     bool isReady = false;
@@ -466,3 +546,165 @@ TEST_CASE("Futures_waiter", "[futures]") {
     t.join();
     CHECK(b.load() == true);
 }
+
+TEST_CASE("Futures_whenAny", "[futures]") {
+    Promise<int> p1;
+    Promise<int> p2;
+    Promise<int> p3;
+    Future<std::pair<size_t, int> > rez = whenAny(p1.future(), p2.future(), p3.future());
+    CHECK(!rez.isComplete());
+    p2.set(7);
+    CHECK(rez.isComplete());
+    p1.set(3);
+    CHECK(rez.get().first == 1);
+    CHECK(rez.get().second == 7);
+}
+
+TEST_CASE("Futures_whenAny_vector_void", "[futures]") {
+    ThreadPool tp(4);
+    std::vector<Future<void> > futures;
+    Promise<void> never;
+    futures.push_back(never.future());
+    futures.push_back(runAsync(&tp, [](){delay(20);}));
+    futures.push_back(never.future());
+    Future<size_t> rez = whenAny(futures);
+    CHECK(rez.get() == 1);
+    never.set();
+}
+
+TEST_CASE("Futures_whenAny_exception", "[futures]") {
+    Promise<int> p1;
+    Promise<int> p2;
+    Future<std::pair<size_t, int> > rez = whenAny(p1.future(), p2.future());
+    p1.setException(std::make_exception_ptr(std::runtime_error("test")));
+    p2.set(5);
+    CHECK(rez.isException());
+    CHECK_THROWS_AS(rez.get(), std::runtime_error);
+}
+
+TEST_CASE("Futures_whenAny_empty", "[futures]") {
+    Future<std::pair<size_t, int> > rez = whenAny(std::vector<Future<int> >());
+    CHECK_THROWS_AS(rez.get(), std::invalid_argument);
+}
+
+TEST_CASE("Futures_whenAny_releases_result", "[futures]") {
+    // A pending input must not keep the result alive
+    Promise<int> slow;
+    std::weak_ptr<int> weakValue;
+    {
+        std::shared_ptr<int> value = std::make_shared<int>(42);
+        weakValue = value;
+        std::vector<Future<std::shared_ptr<int> > > futures;
+        futures.push_back(slow.future().then([](int v) {return std::make_shared<int>(v);}));
+        futures.push_back(completedFuture(std::move(value)));
+        auto rez = whenAny(std::move(futures));
+        CHECK(*rez.get().second == 42);
+    }
+    CHECK(weakValue.expired());
+    slow.set(1);
+}
+
+TEST_CASE("Futures_loop_completed_body", "[futures]") {
+    // The body returns completed futures; the loop must neither grow the stack nor hop through the executor
+    constexpr int nrIterations = 1000000;
+    Future<int> res = completedFuture(0).thenAsyncLoop(
+        [](int v)->bool{return v<nrIterations;},
+        [](int v)->Future<int> {return completedFuture(v+1);});
+    CHECK(res.get() == nrIterations);
+}
+
+TEST_CASE("Futures_loop_completed_body_void", "[futures]") {
+    constexpr int nrIterations = 1000000;
+    int count = 0;
+    Future<void> res = completedFuture().thenAsyncLoop(
+        [&count]()->bool{return count<nrIterations;},
+        [&count]()->Future<void> {++count; return completedFuture();});
+    res.wait();
+    CHECK(res.isCompletedNormally());
+    CHECK(count == nrIterations);
+}
+
+TEST_CASE("Futures_executeAsyncLoop_mixed", "[futures]") {
+    ThreadPool tp(4);
+    Future<int> res = executeAsyncLoop(&tp,
+        [](int v)->bool{return v<10000;},
+        [&tp](int v)->Future<int> {
+            if(v % 100 == 0) {
+                return runAsync(&tp, [v](){return v+1;});
+            }
+            return completedFuture(v+1);
+        },
+        0);
+    CHECK(res.get() == 10000);
+}
+
+TEST_CASE("Futures_loop_body_throws", "[futures]") {
+    ThreadPool tp(2);
+    Future<int> res = completedFuture(0).thenAsyncLoop(&tp,
+        [](int)->bool{return true;},
+        [&tp](int v)->Future<int> {
+            if(v == 5) {
+                throw std::runtime_error("test");
+            }
+            return runAsync(&tp, [v](){return v+1;});
+        });
+    CHECK_THROWS_AS(res.get(), std::runtime_error);
+}
+
+TEST_CASE("Futures_whenAllReduce", "[futures]") {
+    ThreadPool tp(4);
+    std::vector<Future<int> > futures;
+    for(int i=1 ; i<=1000 ; ++i) {
+        futures.push_back(runAsync(&tp, [i](){return i;}));
+    }
+    Future<long> rez = whenAllReduce(&tp, std::move(futures), 0L, [](long acc, int v) {return acc + v;});
+    CHECK(rez.get() == 500500);
+}
+
+TEST_CASE("Futures_whenAllReduce_inline_incremental", "[futures]") {
+    Promise<int> p1;
+    Promise<int> p2;
+    int nrFolded = 0;
+    Future<int> rez = whenAllReduce(inlineExecutor(), std::vector<Future<int> >{p1.future(), p2.future()}, 1,
+        [&nrFolded](int acc, int v) {++nrFolded; return acc * v;});
+    p2.set(3);
+    CHECK(nrFolded == 1);
+    CHECK(!rez.isComplete());
+    p1.set(5);
+    CHECK(nrFolded == 2);
+    CHECK(rez.get() == 15);
+}
+
+TEST_CASE("Futures_whenAllReduce_empty", "[futures]") {
+    Future<int> rez = whenAllReduce(std::vector<Future<int> >(), 7, [](int acc, int v) {return acc + v;});
+    CHECK(rez.get() == 7);
+}
+
+TEST_CASE("Futures_whenAllReduce_exception", "[futures]") {
+    Promise<int> p1;
+    Promise<int> p2;
+    Future<int> rez = whenAllReduce(inlineExecutor(), std::vector<Future<int> >{p1.future(), p2.future()}, 0,
+        [](int acc, int v) {return acc + v;});
+    p1.setException(std::make_exception_ptr(std::runtime_error("test")));
+    CHECK(rez.isException());
+    p2.set(1);
+    CHECK_THROWS_AS(rez.get(), std::runtime_error);
+}
+
+TEST_CASE("Futures_whenAllReduce_releases_values", "[futures]") {
+    // A value is dropped as soon as it is folded, before the other futures complete
+    Promise<std::shared_ptr<int> > p1;
+    Promise<std::shared_ptr<int> > p2;
+    std::weak_ptr<int> weakValue;
+    Future<int> rez = whenAllReduce(inlineExecutor(), std::vector<Future<std::shared_ptr<int> > >{p1.future(), p2.future()}, 0,
+        [](int acc, std::shared_ptr<int>& v) {return acc + *v;});
+    {
+        std::shared_ptr<int> value = std::make_shared<int>(2);
+        weakValue = value;
+        p1.set(std::move(value));
+    }
+    p1 = Promise<std::shared_ptr<int> >();
+    CHECK(weakValue.expired());
+    p2.set(std::make_shared<int>(3));
+    CHECK(rez.get() == 5);
+}
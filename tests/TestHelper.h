@@ -6,6 +6,9 @@
 
 #include "carpal/Future.h"
 
+#include <atomic>
+#include <memory_resource>
+
 inline
 void delay(unsigned milliseconds = 10) {
     std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
@@ -78,3 +81,22 @@ public:
 private:
     int m_val;
 };
+
+/** @brief Memory resource counting the allocations and deallocations, forwarded to @c new and @c delete*/
+class CountingResource : public std::pmr::memory_resource {
+public:
+    std::atomic_int nrAllocations{0};
+    std::atomic_int nrDeallocations{0};
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        ++nrAllocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+        ++nrDeallocations;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+        return this == &other;
+    }
+};
@@ -0,0 +1,91 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/Future.h"
+#include "carpal/MemoryResource.h"
+#include "carpal/ThreadPool.h"
+
+#include <catch2/catch.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <set>
+
+#include "TestHelper.h"
+
+using namespace carpal;
+
+TEST_CASE("MemoryResource_scope", "[memory]") {
+    CountingResource r1;
+    CountingResource r2;
+    CHECK(currentMemoryResource() == nullptr);
+    {
+        MemoryResourceScope scope1(&r1);
+        CHECK(currentMemoryResource() == &r1);
+        {
+            MemoryResourceScope scope2(&r2);
+            CHECK(currentMemoryResource() == &r2);
+        }
+        CHECK(currentMemoryResource() == &r1);
+    }
+    CHECK(currentMemoryResource() == nullptr);
+}
+
+TEST_CASE("MemoryResource_futures", "[memory]") {
+    CountingResource resource;
+    {
+        ThreadPool tp(2);
+        std::optional<Future<int> > f;
+        {
+            MemoryResourceScope scope(&resource);
+            Promise<int> p;
+            f = p.future()
+                .then(&tp, [](int v) { return v + 1; })
+                .then(&tp, [](int v) { return v * 2; });
+            p.set(4);
+        }
+        CHECK(f->get() == 10);
+        CHECK(resource.nrAllocations.load() == 3);
+    }
+    CHECK(resource.nrDeallocations.load() == 3);
+}
+
+TEST_CASE("ThreadLocalPoolResource_sizes", "[memory]") {
+    std::pmr::memory_resource* pPool = threadLocalPoolResource();
+    std::vector<std::pair<void*, std::size_t> > blocks;
+    std::set<void*> distinct;
+    bool allAligned = true;
+    for(int i=0 ; i<2000 ; ++i) {
+        std::size_t size = 1 + (i * 37) % 700;
+        void* p = pPool->allocate(size, 8);
+        if(reinterpret_cast<std::uintptr_t>(p) % 8 != 0) allAligned = false;
+        memset(p, 0x5a, size);
+        blocks.emplace_back(p, size);
+        distinct.insert(p);
+    }
+    CHECK(allAligned);
+    CHECK(distinct.size() == blocks.size());
+    for(auto const& b : blocks) {
+        pPool->deallocate(b.first, b.second, 8);
+    }
+    void* pAligned = pPool->allocate(64, 64);
+    CHECK(reinterpret_cast<std::uintptr_t>(pAligned) % 64 == 0);
+    pPool->deallocate(pAligned, 64, 64);
+}
+
+TEST_CASE("ThreadLocalPoolResource_cross_thread", "[memory]") {
+    ThreadPool tp(4);
+    std::vector<Future<int> > futures;
+    {
+        MemoryResourceScope scope(threadLocalPoolResource());
+        for(int i=0 ; i<1000 ; ++i) {
+            futures.push_back(runAsync(&tp, [i]() { return i; }).then(&tp, [](int v) { return v + 1; }));
+        }
+    }
+    Future<int> sum = whenAllFromArrayOfFutures(&tp, [](std::vector<Future<int> > results) {
+        int s = 0;
+        for(auto& f : results) s += f.get();
+        return s;
+    }, std::move(futures));
+    CHECK(sum.get() == 1000 * 1001 / 2);
+}
@@ -0,0 +1,164 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/ParallelAlgorithms.h"
+#include "carpal/ThreadPool.h"
+
+#include <catch2/catch.hpp>
+
+#include <deque>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "TestHelper.h"
+
+using namespace carpal;
+
+namespace {
+
+/** @brief Forwards the tasks to another executor, counting them*/
+class CountingExecutor : public Executor {
+public:
+    explicit CountingExecutor(Executor* pTarget)
+        :m_pTarget(pTarget)
+    {}
+
+    void enqueue(Runnable func) override {
+        ++nrTasks;
+        m_pTarget->enqueue(std::move(func));
+    }
+
+    std::atomic_int nrTasks{0};
+private:
+    Executor* m_pTarget;
+};
+
+/** @brief Rejects all tasks*/
+class RejectingExecutor : public Executor {
+public:
+    void enqueue(Runnable) override {
+        throw ExecutorRejectedException();
+    }
+    bool tryEnqueue(Runnable&) override {
+        return false;
+    }
+};
+
+/** @brief Keeps the tasks until run, one at a time, by @c runAll(), as a busy executor would*/
+class DeferredExecutor : public Executor {
+public:
+    void enqueue(Runnable func) override {
+        ++nrTasks;
+        m_tasks.push_back(std::move(func));
+    }
+
+    void runAll() {
+        while(!m_tasks.empty()) {
+            Runnable task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            task();
+        }
+    }
+
+    int nrTasks = 0;
+private:
+    std::deque<Runnable> m_tasks;
+};
+
+} // namespace
+
+TEST_CASE("parallelFor_simple", "[parallel]") {
+    ThreadPool tp(4);
+    std::vector<int> v(100000, 0);
+    parallelFor(&tp, 0, v.size(), [&v](size_t i) {
+        v[i] = int(i);
+    }).wait();
+    bool allCorrect = true;
+    for(size_t i=0 ; i<v.size() ; ++i) {
+        allCorrect = allCorrect && (v[i] == int(i));
+    }
+    CHECK(allCorrect);
+}
+
+TEST_CASE("parallelFor_subrange", "[parallel]") {
+    ThreadPool tp(4);
+    std::vector<int> v(100, 0);
+    parallelFor(&tp, 10, 20, [&v](size_t i) {
+        v[i] = 1;
+    }).wait();
+    CHECK(std::accumulate(v.begin(), v.end(), 0) == 10);
+    CHECK(v[10] == 1);
+    CHECK(v[19] == 1);
+    CHECK(parallelFor(&tp, 20, 10, [](size_t) {}).isCompletedNormally());
+}
+
+TEST_CASE("parallelFor_few_tasks", "[parallel]") {
+    ThreadPool tp(4);
+    CountingExecutor executor(&tp);
+    constexpr size_t size = 10000000;
+    std::atomic<size_t> count{0};
+    parallelFor(&executor, 0, size, [&count](size_t) {
+        count.fetch_add(1, std::memory_order_relaxed);
+    }).wait();
+    CHECK(count == size);
+    size_t nrThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    CHECK(size_t(executor.nrTasks) <= 32 * nrThreads);
+}
+
+TEST_CASE("parallelFor_lazy_split", "[parallel]") {
+    // chunks are not split while enough of them wait for a thread
+    DeferredExecutor executor;
+    constexpr size_t size = 100000;
+    size_t count = 0;
+    Future<void> f = parallelFor(&executor, 0, size, [&count](size_t) {
+        ++count;
+    });
+    executor.runAll();
+    CHECK(f.isCompletedNormally());
+    CHECK(count == size);
+    size_t nrThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    CHECK(size_t(executor.nrTasks) < 16 * nrThreads);
+}
+
+TEST_CASE("parallelFor_exception", "[parallel]") {
+    ThreadPool tp(4);
+    Future<void> f = parallelFor(&tp, 0, 100000, [](size_t i) {
+        if(i == 5000) {
+            throw std::runtime_error("test");
+        }
+    });
+    f.wait();
+    CHECK(f.isException());
+}
+
+TEST_CASE("parallelFor_rejected", "[parallel]") {
+    RejectingExecutor executor;
+    Future<void> f = parallelFor(&executor, 0, 100, [](size_t) {});
+    CHECK(f.isException());
+}
+
+TEST_CASE("parallelTransform_simple", "[parallel]") {
+    ThreadPool tp(4);
+    std::vector<int> in(100000);
+    std::iota(in.begin(), in.end(), 0);
+    std::vector<long> out(in.size());
+    parallelTransform(&tp, in.begin(), in.end(), out.begin(), [](int x) {return long(x) * 2;}).wait();
+    bool allCorrect = true;
+    for(size_t i=0 ; i<out.size() ; ++i) {
+        allCorrect = allCorrect && (out[i] == long(i) * 2);
+    }
+    CHECK(allCorrect);
+}
+
+TEST_CASE("parallelReduce_simple", "[parallel]") {
+    ThreadPool tp(4);
+    std::vector<int> in(1000000);
+    std::iota(in.begin(), in.end(), 1);
+    Future<long> sum = parallelReduce(&tp, in.begin(), in.end(), 10L, [](long acc, long x) {return acc + x;});
+    CHECK(sum.get() == 10L + 1000000L * 1000001L / 2);
+    std::vector<int> empty;
+    CHECK(parallelReduce(&tp, empty.begin(), empty.end(), 7, [](int a, int b) {return a + b;}).get() == 7);
+}
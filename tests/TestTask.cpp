@@ -0,0 +1,130 @@
+// Copyright Radu Lupsa 2023
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE.txt or copy at  https://www.boost.org/LICENSE_1_0.txt )
+
+#include "carpal/AsyncCoroutine.h"
+#include "carpal/ExecutorCoroutineScheduler.h"
+#include "carpal/Future.h"
+#include "carpal/Task.h"
+#include "carpal/ThreadPool.h"
+
+#include <catch2/catch.hpp>
+
+#include <stdexcept>
+
+#include "TestHelper.h"
+
+using namespace carpal;
+
+namespace {
+
+Task<int> taskAdd(int a, int b) {
+    co_return a + b;
+}
+
+Task<int> taskNested(int v) {
+    int x = co_await taskAdd(v, 1);
+    int y = co_await taskAdd(x, 2);
+    co_return y;
+}
+
+Task<int> taskFuture(Future<int> f) {
+    int v = co_await f;
+    co_return v + 1;
+}
+
+Task<int> taskFutureNested(Future<int> f) {
+    int v = co_await taskFuture(f);
+    co_return v * 2;
+}
+
+Task<int> taskThrow() {
+    throw std::runtime_error("test");
+    co_return 0;
+}
+
+Task<> taskVoid(int& dest, int v) {
+    dest = v;
+    co_return;
+}
+
+Task<long> taskLoop(int count) {
+    long sum = 0;
+    for(int i=0 ; i<count ; ++i) {
+        sum += co_await taskAdd(i, 0);
+    }
+    co_return sum;
+}
+
+Task<int> taskRecursive(int depth) {
+    if(depth == 0) {
+        co_return 0;
+    }
+    co_return (co_await taskRecursive(depth - 1)) + 1;
+}
+
+AsyncCoroutine<int> coroAwaitTask(AbstractCoroutineScheduler*, Future<int> f) {
+    int v = co_await taskFutureNested(f);
+    co_return v + 1;
+}
+
+} // namespace
+
+TEST_CASE("Task_nested", "[task]") {
+    CHECK(taskNested(10).start().get() == 13);
+}
+
+TEST_CASE("Task_lazy", "[task]") {
+    int dest = 0;
+    Task<> task = taskVoid(dest, 5);
+    CHECK(dest == 0);
+    std::move(task).start().wait();
+    CHECK(dest == 5);
+}
+
+TEST_CASE("Task_exception", "[task]") {
+    Future<int> f = taskThrow().start();
+    CHECK_THROWS_AS(f.get(), std::runtime_error);
+}
+
+TEST_CASE("Task_future_not_completed", "[task]") {
+    Promise<int> p;
+    Future<int> f = taskFutureNested(p.future()).start();
+    CHECK(!f.isComplete());
+    auto fx = executeLaterVoid([p](){
+        p.set(20);
+    }, 30);
+    CHECK(f.get() == 42);
+}
+
+TEST_CASE("Task_from_AsyncCoroutine", "[task]") {
+    CoroutineScheduler scheduler;
+    Promise<int> p;
+    auto fx = executeLaterVoid([p](){
+        p.set(20);
+    }, 30);
+    auto coro = coroAwaitTask(&scheduler, p.future());
+    CHECK(coro.get() == 43);
+}
+
+TEST_CASE("Task_from_AsyncCoroutine_executor", "[task]") {
+    ThreadPool tp(2);
+    ExecutorCoroutineScheduler scheduler(&tp);
+    Promise<int> p;
+    auto coro = coroAwaitTask(&scheduler, p.future());
+    auto fx = executeLaterVoid([p](){
+        p.set(20);
+    }, 30);
+    CHECK(coro.get() == 43);
+}
+
+TEST_CASE("Task_long_loop", "[task]") {
+    // Each awaited task completes synchronously; the loop must not nest deeper into the stack on each iteration.
+    constexpr int count = 1000000;
+    CHECK(taskLoop(count).start().get() == long(count) * (count - 1) / 2);
+}
+
+TEST_CASE("Task_recursion", "[task]") {
+    constexpr int depth = 1000;
+    CHECK(taskRecursive(depth).start().get() == depth);
+}
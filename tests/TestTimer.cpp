@@ -4,9 +4,11 @@
 
 #include "carpal/Future.h"
 #include "carpal/Timer.h"
+#include "carpal/ShardedAlarmClock.h"
 #include "carpal/ThreadPool.h"
 
 #include <catch2/catch.hpp>
+#include <optional>
 #include <stdio.h>
 
 #include "TestHelper.h"
@@ -43,3 +45,339 @@ TEST_CASE("Alarm_cancel", "[timer]") {
     CHECK(!timer.getFuture().get());
     CHECK(std::chrono::system_clock::now() < now + std::chrono::milliseconds(50));
 }
+
+TEST_CASE("TimingWheel_alarm", "[timer]") {
+    AlarmClock clock(AlarmClock::Backend::timingWheel, std::chrono::milliseconds(1));
+    std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+    Timer timer = clock.setTimer(now + std::chrono::milliseconds(50));
+
+    CHECK(!timer.getFuture().isComplete());
+    CHECK(timer.getFuture().get());
+    CHECK(std::chrono::system_clock::now() >= now + std::chrono::milliseconds(50));
+}
+
+TEST_CASE("TimingWheel_many_timers", "[timer]") {
+    // a tick of 10us makes the timers below span 3 levels of the wheel
+    AlarmClock clock(AlarmClock::Backend::timingWheel, std::chrono::microseconds(10));
+    constexpr int nrTimers = 300;
+    std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+    std::vector<std::chrono::system_clock::time_point> deadlines;
+    std::vector<Timer> timers;
+    std::vector<Future<std::chrono::system_clock::time_point> > firedAt;
+    for(int i=0 ; i<nrTimers ; ++i) {
+        auto when = start + std::chrono::microseconds((i * 7919) % 200000);
+        deadlines.push_back(when);
+        timers.push_back(clock.setTimer(when));
+        firedAt.push_back(timers.back().getFuture().then(inlineExecutor(), [](bool) { return std::chrono::system_clock::now(); }));
+    }
+    for(int i=0 ; i<nrTimers ; i+=3) {
+        timers[i].cancel();
+    }
+    bool allOnTime = true;
+    bool allCanceledOrTriggered = true;
+    for(int i=0 ; i<nrTimers ; ++i) {
+        bool triggered = timers[i].getFuture().get();
+        if(i % 3 == 0 && triggered && deadlines[i] > start + std::chrono::milliseconds(20)) {
+            allCanceledOrTriggered = false;
+        }
+        if(triggered && firedAt[i].get() < deadlines[i]) {
+            allOnTime = false;
+        }
+    }
+    CHECK(allOnTime);
+    CHECK(allCanceledOrTriggered);
+}
+
+TEST_CASE("TimingWheel_cancel_far_timer", "[timer]") {
+    // with a 1ns tick, the wheel covers about a minute; the timer goes to the overflow list
+    AlarmClock clock(AlarmClock::Backend::timingWheel, std::chrono::nanoseconds(1));
+    Timer far = clock.setTimer(std::chrono::system_clock::now() + std::chrono::seconds(600));
+    Timer near = clock.setTimer(std::chrono::system_clock::now() + std::chrono::milliseconds(20));
+    far.cancel();
+    CHECK(!far.getFuture().get());
+    CHECK(near.getFuture().get());
+}
+
+TEST_CASE("Alarm_set_from_callback", "[timer]") {
+    for(AlarmClock::Backend backend : {AlarmClock::Backend::orderedSet, AlarmClock::Backend::timingWheel}) {
+        AlarmClock clock(backend);
+        Future<bool> second = clock.setTimerAfter(std::chrono::milliseconds(10)).getFuture()
+            .thenAsync(inlineExecutor(), [&clock](bool) {
+                return clock.setTimerAfter(std::chrono::milliseconds(10)).getFuture();
+            });
+        CHECK(second.get());
+    }
+}
+
+TEST_CASE("Alarm_steady_clock", "[timer]") {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    Timer timer = alarmClock()->setTimer(now + std::chrono::milliseconds(50));
+    Timer timer2 = alarmClock()->setTimerAfter(std::chrono::milliseconds(20));
+
+    CHECK(!timer.getFuture().isComplete());
+    CHECK(timer2.getFuture().get());
+    CHECK(std::chrono::steady_clock::now() >= now + std::chrono::milliseconds(20));
+    CHECK(timer.getFuture().get());
+    CHECK(std::chrono::steady_clock::now() >= now + std::chrono::milliseconds(50));
+}
+
+TEST_CASE("Alarm_system_clock_extremes", "[timer]") {
+    for(AlarmClock::Backend backend : {AlarmClock::Backend::orderedSet, AlarmClock::Backend::timingWheel}) {
+        AlarmClock clock(backend);
+        Timer never = clock.setTimer(std::chrono::system_clock::time_point::max());
+        Timer past = clock.setTimer(std::chrono::system_clock::time_point::min());
+        CHECK(past.getFuture().get());
+        CHECK(!never.getFuture().isComplete());
+        never.cancel();
+        CHECK(!never.getFuture().get());
+    }
+}
+
+TEST_CASE("Alarm_slack_coalesces", "[timer]") {
+    AlarmClock clock;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point first = start + std::chrono::milliseconds(20);
+    std::chrono::steady_clock::time_point last = first + std::chrono::microseconds(490);
+    std::vector<Future<std::chrono::steady_clock::time_point> > firedAt;
+    for(int i=0 ; i<50 ; ++i) {
+        firedAt.push_back(clock.setTimer(first + std::chrono::microseconds(10*i), std::chrono::milliseconds(5)).getFuture()
+            .then(inlineExecutor(), [](bool) { return std::chrono::steady_clock::now(); }));
+    }
+    // the clock wakes up when the slack of the first timer runs out, and by then all the timers are due
+    CHECK(firedAt.front().get() >= last);
+    for(int i=0 ; i<50 ; ++i) {
+        CHECK(firedAt[i].get() >= first + std::chrono::microseconds(10*i));
+    }
+}
+
+TEST_CASE("Alarm_default_slack", "[timer]") {
+    for(AlarmClock::Backend backend : {AlarmClock::Backend::orderedSet, AlarmClock::Backend::timingWheel}) {
+        AlarmClock clock(backend);
+        clock.setDefaultSlack(std::chrono::milliseconds(10));
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        Timer timer = clock.setTimerAfter(std::chrono::milliseconds(20));
+        CHECK(timer.getFuture().get());
+        CHECK(std::chrono::steady_clock::now() >= now + std::chrono::milliseconds(20));
+    }
+}
+
+TEST_CASE("TimedAction_simple", "[timer]") {
+    ThreadPool tp(2);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    TimedAction<int> action = alarmClock()->setTimedAction(now + std::chrono::milliseconds(30), &tp, []() { return 42; });
+    TimedAction<void> voidAction = alarmClock()->setTimedActionAfter(std::chrono::milliseconds(10), &tp, []() {});
+    Future<int> f = action;
+
+    CHECK(!f.isComplete());
+    voidAction.getFuture().wait();
+    CHECK(voidAction.getFuture().isCompletedNormally());
+    CHECK(f.get() == 42);
+    CHECK(std::chrono::steady_clock::now() >= now + std::chrono::milliseconds(30));
+}
+
+TEST_CASE("TimedAction_cancel", "[timer]") {
+    std::atomic<bool> executed{false};
+    TimedAction<int> action = alarmClock()->setTimedActionAfter(std::chrono::milliseconds(50), [&executed]() {
+        executed = true;
+        return 1;
+    });
+    action.cancel();
+    CHECK(action.getFuture().isException());
+    CHECK_THROWS_AS(action.getFuture().get(), TimerCanceledException);
+    CHECK(!executed);
+}
+
+TEST_CASE("TimedAction_runs_off_the_alarm_thread", "[timer]") {
+    ThreadPool tp(2);
+    AlarmClock clock;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    Promise<void> release;
+    Future<void> releaseFuture = release.future();
+    // a slow action must not delay the timers after it
+    TimedAction<void> slow = clock.setTimedAction(now + std::chrono::milliseconds(10), &tp, [releaseFuture]() { releaseFuture.wait(); });
+    TimedAction<std::chrono::steady_clock::time_point> fast = clock.setTimedAction(now + std::chrono::milliseconds(20), &tp,
+        []() { return std::chrono::steady_clock::now(); });
+    CHECK(fast.getFuture().get() < now + std::chrono::seconds(5));
+    CHECK(!slow.getFuture().isComplete());
+    release.set();
+    slow.getFuture().wait();
+}
+
+TEST_CASE("PeriodicTimer_fixed_rate", "[timer]") {
+    // the pool is destroyed first, so that no execution outlives the clock
+    AlarmClock clock;
+    ThreadPool tp(2);
+    std::atomic<int> count{0};
+    Promise<void> done;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Timer timer = clock.setPeriodicTimer(start + std::chrono::milliseconds(10), std::chrono::milliseconds(10), &tp,
+        [&count, &done]() {
+            if(++count == 5) {
+                done.set();
+            }
+        });
+    done.future().wait();
+    CHECK(std::chrono::steady_clock::now() >= start + std::chrono::milliseconds(50));
+    timer.cancel();
+    CHECK(!timer.getFuture().get());
+    int countAfterCancel = count;
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    // an execution may have been in progress at the time of the cancel
+    CHECK(count <= countAfterCancel + 1);
+}
+
+TEST_CASE("PeriodicTimer_fixed_delay", "[timer]") {
+    AlarmClock clock(AlarmClock::Backend::timingWheel);
+    ThreadPool tp(2);
+    std::vector<std::chrono::steady_clock::time_point> starts;
+    std::vector<std::chrono::steady_clock::time_point> ends;
+    Promise<void> done;
+    Timer timer = clock.setPeriodicTimer(std::chrono::steady_clock::now(), std::chrono::milliseconds(5), &tp,
+        [&starts, &ends, &done]() {
+            // the executions do not overlap, so no synchronization is needed; the ones after the 4th may run while
+            // the vectors are read, so they do not modify them
+            if(starts.size() == 4) return;
+            starts.push_back(std::chrono::steady_clock::now());
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            ends.push_back(std::chrono::steady_clock::now());
+            if(starts.size() == 4) {
+                done.set();
+            }
+        }, AlarmClock::Schedule::fixedDelay);
+    done.future().wait();
+    timer.cancel();
+    timer.getFuture().wait();
+    for(size_t i=1 ; i<4 ; ++i) {
+        CHECK(starts[i] >= ends[i-1] + std::chrono::milliseconds(5));
+    }
+}
+
+TEST_CASE("PeriodicTimer_exception_stops", "[timer]") {
+    AlarmClock clock;
+    std::atomic<int> count{0};
+    Timer timer = clock.setPeriodicTimer(std::chrono::steady_clock::now(), std::chrono::milliseconds(1), defaultExecutor(),
+        [&count]() {
+            if(++count == 3) {
+                throw std::runtime_error("stop");
+            }
+        });
+    CHECK_THROWS_AS(timer.getFuture().get(), std::runtime_error);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CHECK(count == 3);
+}
+
+TEST_CASE("PeriodicTimer_clock_destroyed_while_executing", "[timer]") {
+    // the destructor of the clock must wait for the execution, which re-arms the timer on the clock when it ends
+    ThreadPool tp(1);
+    std::optional<AlarmClock> clock;
+    clock.emplace();
+    std::atomic_bool isStarted{false};
+    std::atomic_bool isFinished{false};
+    Timer timer = clock->setPeriodicTimer(std::chrono::steady_clock::now(), std::chrono::milliseconds(1), &tp,
+        [&isStarted, &isFinished]() {
+            if(isStarted.exchange(true)) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            isFinished = true;
+        });
+    while(!isStarted) {
+        std::this_thread::yield();
+    }
+    clock.reset();
+    CHECK(isFinished);
+    CHECK(!timer.getFuture().get());
+}
+
+TEST_CASE("Alarm_close_cancels", "[timer]") {
+    AlarmClock clock;
+    ThreadPool tp(1);
+    Timer timer = clock.setTimerAfter(std::chrono::seconds(3600));
+    Timer periodic = clock.setPeriodicTimer(std::chrono::steady_clock::now(), std::chrono::milliseconds(1), &tp, []() {});
+    clock.close();
+    CHECK(!timer.getFuture().get());
+    CHECK(!periodic.getFuture().get());
+    CHECK(!clock.setTimerAfter(std::chrono::milliseconds(1)).getFuture().get());
+}
+
+TEST_CASE("Future_withTimeout", "[timer]") {
+    Promise<int> slow;
+    Future<int> f1 = withTimeout(slow.future(), std::chrono::milliseconds(20));
+    CHECK_THROWS_AS(f1.get(), TimeoutException);
+
+    Promise<int> fast;
+    Future<int> f2 = withTimeout(fast.future(), std::chrono::seconds(3600));
+    fast.set(5);
+    CHECK(f2.get() == 5);
+
+    Future<int> f3 = withTimeout(completedFuture<int>(7), std::chrono::seconds(3600));
+    CHECK(f3.get() == 7);
+
+    Promise<void> slowVoid;
+    Future<void> f4 = withTimeout(slowVoid.future(), std::chrono::milliseconds(20));
+    f4.wait();
+    CHECK(f4.isException());
+    slow.set(1);
+    slowVoid.set();
+}
+
+TEST_CASE("Future_orDefault", "[timer]") {
+    Promise<std::string> slow;
+    Future<std::string> f1 = orDefault(slow.future(), std::chrono::milliseconds(20), "default");
+    CHECK(f1.get() == "default");
+    slow.set("late");
+
+    Promise<std::string> fast;
+    Future<std::string> f2 = orDefault(fast.future(), std::chrono::seconds(3600), "default");
+    fast.set("value");
+    CHECK(f2.get() == "value");
+}
+
+TEST_CASE("Future_orDefault_executor", "[timer]") {
+    // the fallback and the continuations run on the given executor, not on the thread of the clock
+    ThreadPool tp(1);
+    AlarmClock clock;
+    std::thread::id poolThreadId = runAsync(&tp, []() {return std::this_thread::get_id();}).get();
+    std::thread::id continuationThreadId;
+    Promise<int> slow;
+    Future<int> f = orDefault(slow.future(), &clock, &tp, std::chrono::milliseconds(5), 0).thenInline([&continuationThreadId](int v) {
+        continuationThreadId = std::this_thread::get_id();
+        return v;
+    });
+    CHECK(f.get() == 0);
+    CHECK(continuationThreadId == poolThreadId);
+    slow.set(1);
+}
+
+TEST_CASE("ShardedAlarmClock_timers", "[timer]") {
+    ShardedAlarmClock clock(4);
+    CHECK(clock.nrShards() == 4);
+    constexpr int nrThreads = 8;
+    std::vector<Timer> toCancel[nrThreads];
+    std::vector<Future<bool> > futures[nrThreads];
+    std::vector<std::thread> threads;
+    for(int t=0 ; t<nrThreads ; ++t) {
+        threads.emplace_back([&clock, &toCancel, &futures, t]() {
+            for(int i=0 ; i<20 ; ++i) {
+                futures[t].push_back(clock.setTimerAfter(std::chrono::milliseconds(i)).getFuture());
+                toCancel[t].push_back(clock.setTimerAfter(std::chrono::seconds(3600)));
+            }
+        });
+    }
+    for(auto& th : threads) {
+        th.join();
+    }
+    bool allTriggered = true;
+    bool allCanceled = true;
+    for(int t=0 ; t<nrThreads ; ++t) {
+        // cancel from a thread other than the one that set the timers
+        for(Timer& timer : toCancel[t]) {
+            timer.cancel();
+            allCanceled = allCanceled && !timer.getFuture().get();
+        }
+        for(Future<bool>& f : futures[t]) {
+            allTriggered = allTriggered && f.get();
+        }
+    }
+    CHECK(allTriggered);
+    CHECK(allCanceled);
+    CHECK(clock.setTimedActionAfter(std::chrono::milliseconds(1), []() { return 3; }).getFuture().get() == 3);
+}